@@ -0,0 +1,299 @@
+// bench.cpp : mvec.cpp の各処理時間を計測するベンチマーク
+//
+// 合成した輝度画像（ベタ・ノイズ・パン・シーンチェンジ・レターボックス）を使い
+// dist/avgdist/maxmin_block/tree_search/full_search/mvec を単体で計測して
+// 結果をJSONで出力する。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <vector>
+#include <algorithm>
+#include "mvec.h"
+
+#ifndef _WIN32
+#include <malloc.h>
+#define _aligned_malloc(a,b) memalign(b,a)
+#define _aligned_free free
+#endif
+
+// 計測対象
+enum {
+	K_DIST = 0,
+	K_AVGDIST,
+	K_MAXMIN,
+	K_TREE,
+	K_FULL,
+	K_MVEC,
+	K_NUM
+};
+static const char *kernel_name[K_NUM] = {"dist", "avgdist", "maxmin_block", "tree_search", "full_search", "mvec"};
+
+// 入力画像パターン
+enum {
+	P_FLAT = 0,
+	P_NOISE,
+	P_PAN,
+	P_CUT,
+	P_LETTERBOX,
+	P_NUM
+};
+static const char *pattern_name[P_NUM] = {"flat", "noise", "pan", "cut", "letterbox"};
+
+static const int bench_size[][2] = {{720, 480}, {1440, 1080}, {1920, 1080}, {3840, 2160}};
+#define NUM_SIZE (int)(sizeof(bench_size) / sizeof(bench_size[0]))
+
+#define FULL_SEARCH_EXTENT 8	// full_search計測時の探索範囲
+
+static volatile int bench_sink;	// 最適化で計算が消えないように結果を書き込む
+
+//---------------------------------------------------------------------
+//		時間取得
+//---------------------------------------------------------------------
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//---------------------------------------------------------------------
+//		合成画像作成
+//---------------------------------------------------------------------
+static uint32_t rnd_state = 1;
+static int rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 16) & 0x7FFF;
+}
+
+// 座標から決まる模様（動き検索で位置が特定できるようにする）
+static unsigned char texture(int x, int y, int seed)
+{
+	double v = 128 + 50 * sin(x * 0.071 + seed) * cos(y * 0.053 - seed)
+				   + 30 * sin((x + y * 2) * 0.19 + seed * 3);
+	v += ((x * 7919 + y * 104729 + seed * 31) % 23) - 11;
+	if (v < 0) v = 0;
+	if (v > 255) v = 255;
+	return (unsigned char)v;
+}
+
+static void make_pattern(int pattern, unsigned char *cur, unsigned char *bef, int w, int h)
+{
+	rnd_state = 1;
+	for (int y=0; y<h; y++) {
+		for (int x=0; x<w; x++) {
+			unsigned char c, b;
+			switch (pattern) {
+			case P_FLAT:
+				c = b = 96;
+				break;
+			case P_NOISE:
+				b = texture(x, y, 0);
+				c = (unsigned char)std::min(255, std::max(0, b + (rnd() % 9) - 4));
+				break;
+			case P_PAN:
+				b = texture(x, y, 0);
+				c = texture(x + 5, y + 2, 0);
+				break;
+			case P_CUT:
+				b = texture(x, y, 0);
+				c = texture(x, y, 7);
+				break;
+			default:	// P_LETTERBOX
+				if (y < h / 8 || y >= h - h / 8) {
+					c = b = 16;
+				} else {
+					b = texture(x, y, 0);
+					c = texture(x + 5, y + 2, 0);
+				}
+				break;
+			}
+			cur[y * w + x] = c;
+			bef[y * w + x] = b;
+		}
+	}
+}
+
+//---------------------------------------------------------------------
+//		1回分の計測（mvec()と同じブロック位置を全て処理）
+//---------------------------------------------------------------------
+static double run_kernel(int kernel, unsigned char *cur, unsigned char *bef, int lx, int ly, int pict_struct, int *nblocks)
+{
+	int sum = 0;
+	int cnt = 0;
+
+	lx2 = lx * pict_struct;
+	block_height = 16 / pict_struct;
+
+	double t0 = now_ns();
+	if (kernel == K_MVEC) {
+		int m1, m2, fsc;
+		sum += mvec(&m1, &m2, &fsc, cur, bef, lx, ly, (100-0)*(100/pict_struct), pict_struct, 0);
+		for (int i=0; i<pict_struct; i++) {
+			for (int y=i+16; y<ly-16; y+=16) {
+				for (int x=16; x<lx-16; x+=16) {
+					cnt++;
+				}
+			}
+		}
+	} else {
+		for (int i=0; i<pict_struct; i++) {
+			for (int y=i+16; y<ly-16; y+=16) {
+				unsigned char *p1 = cur + y*lx + 16;
+				unsigned char *p2 = bef + y*lx + 16;
+				for (int x=16; x<lx-16; x+=16) {
+					int avg, vx = 0, vy = 0;
+					switch (kernel) {
+					case K_DIST:
+						sum += dist(p1, p2, lx2, INT_MAX, block_height);
+						break;
+					case K_AVGDIST:
+						sum += avgdist(&avg, p1, lx2, block_height) + avg;
+						break;
+					case K_MAXMIN:
+						sum += maxmin_block(p1, lx2, block_height);
+						break;
+					case K_TREE:
+						sum += tree_search(p1, p2, lx, ly, &vx, &vy, x, y, INT_MAX, pict_struct, 0);
+						break;
+					case K_FULL:
+						sum += full_search(p1, p2, lx, ly, &vx, &vy, x, y, INT_MAX, pict_struct, FULL_SEARCH_EXTENT);
+						break;
+					}
+					p1 += 16;
+					p2 += 16;
+					cnt++;
+				}
+			}
+		}
+	}
+	double t1 = now_ns();
+	bench_sink += sum;
+	*nblocks = cnt;
+	return t1 - t0;
+}
+
+//---------------------------------------------------------------------
+//		メイン
+//---------------------------------------------------------------------
+int main(int argc, const char* argv[])
+{
+	const char *out = NULL;
+	const char *only_kernel = NULL;
+	const char *only_pattern = NULL;
+	int only_w = 0, only_h = 0;
+	int only_mode = 0;
+	int warmup = 1;
+	int repeat = 5;
+
+	for (int i=1; i<argc; i++) {
+		const char *s = argv[i];
+		if (s[0] == '-' && i+1 < argc) {
+			switch (s[1]) {
+			case 'o':
+				out = argv[++i];
+				break;
+			case 'r':
+				repeat = std::max(1, atoi(argv[++i]));
+				break;
+			case 'w':
+				warmup = std::max(0, atoi(argv[++i]));
+				break;
+			case 'k':
+				only_kernel = argv[++i];
+				break;
+			case 'p':
+				only_pattern = argv[++i];
+				break;
+			case 's':
+				if (sscanf(argv[++i], "%dx%d", &only_w, &only_h) != 2) {
+					only_w = only_h = 0;
+				}
+				break;
+			case 'm':
+				i++;
+				only_mode = (strcmp(argv[i], "frame") == 0) ? FRAME_PICTURE : FIELD_PICTURE;
+				break;
+			default:
+				printf("error: unknown param: %s\n", s);
+				break;
+			}
+		} else {
+			printf("usage: %s [-o out.json] [-r repeat] [-w warmup] [-k kernel] [-p pattern] [-s WxH] [-m frame|field]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	FILE *fout = stdout;
+	if (out) {
+		fout = fopen(out, "w");
+		if (fout == NULL) {
+			printf("Error: output file open failed.\n");
+			return -1;
+		}
+	}
+
+	fprintf(fout, "{\n  \"baseline\": \"sse2\",\n  \"warmup\": %d,\n  \"repeat\": %d,\n", warmup, repeat);
+	fprintf(fout, "  \"full_search_extent\": %d,\n  \"results\": [", FULL_SEARCH_EXTENT);
+	int nresult = 0;
+
+	for (int si=0; si<NUM_SIZE; si++) {
+		int w = bench_size[si][0] & 0xFFFFFFF0;
+		int h = bench_size[si][1] & 0xFFFFFFF0;
+		if (only_w > 0 && (only_w != bench_size[si][0] || only_h != bench_size[si][1])) continue;
+
+		unsigned char *cur = (unsigned char*)_aligned_malloc(w * h, 32);
+		unsigned char *bef = (unsigned char*)_aligned_malloc(w * h, 32);
+
+		for (int pt=0; pt<P_NUM; pt++) {
+			if (only_pattern && strcmp(only_pattern, pattern_name[pt]) != 0) continue;
+			make_pattern(pt, cur, bef, w, h);
+
+			for (int pict=FRAME_PICTURE; pict<=FIELD_PICTURE; pict++) {
+				if (only_mode > 0 && only_mode != pict) continue;
+
+				for (int k=0; k<K_NUM; k++) {
+					if (only_kernel && strcmp(only_kernel, kernel_name[k]) != 0) continue;
+
+					int nblocks = 0;
+					for (int r=0; r<warmup; r++) {
+						run_kernel(k, cur, bef, w, h, pict, &nblocks);
+					}
+					std::vector<double> t;
+					for (int r=0; r<repeat; r++) {
+						t.push_back(run_kernel(k, cur, bef, w, h, pict, &nblocks));
+					}
+					std::sort(t.begin(), t.end());
+					double t_min = t[0];
+					double t_med = t[t.size() / 2];
+					double ns_block = t_med / nblocks;
+					double fps = 1e9 / t_med;
+
+					printf("%-12s %-9s %4dx%-4d %-5s : %9.2f ns/block %8.1f frames/s\n",
+						kernel_name[k], pattern_name[pt], bench_size[si][0], bench_size[si][1],
+						(pict == FRAME_PICTURE) ? "frame" : "field", ns_block, fps);
+
+					fprintf(fout, "%s\n    {\"kernel\": \"%s\", \"pattern\": \"%s\", \"width\": %d, \"height\": %d, \"mode\": \"%s\", ",
+						(nresult > 0) ? "," : "", kernel_name[k], pattern_name[pt],
+						bench_size[si][0], bench_size[si][1], (pict == FRAME_PICTURE) ? "frame" : "field");
+					fprintf(fout, "\"blocks\": %d, \"ns_min\": %.0f, \"ns_median\": %.0f, ", nblocks, t_min, t_med);
+					fprintf(fout, "\"ns_per_block\": %.3f, \"blocks_per_sec\": %.0f, \"frames_per_sec\": %.3f}",
+						ns_block, 1e9 / ns_block, fps);
+					nresult++;
+				}
+			}
+		}
+		_aligned_free(cur);
+		_aligned_free(bef);
+	}
+	fprintf(fout, "\n  ]\n}\n");
+	if (fout != stdout) {
+		fclose(fout);
+	}
+	return 0;
+}
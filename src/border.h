@@ -0,0 +1,81 @@
+// 黒帯（レターボックス・ピラーボックス）の検出
+// --crop auto（AviSynth側での切り取り）と --roi（動き検索の対象範囲）で共通
+#ifndef __BORDER__
+#define __BORDER__
+
+#include <vector>
+#include <algorithm>
+
+// 行・列の平均輝度がこれ未満なら黒帯
+#define BORDER_LUMA 32
+// 黒帯の検出に使うフレーム数
+#define BORDER_SAMPLES 8
+
+// 行・列ごとの平均輝度の最大値（row[h]・col[w]、0で初期化しておく）を１フレーム分更新
+inline void border_accumulate(int *row, int *col, const unsigned char *data, int pitch, int w, int h) {
+	std::vector<int> colsum(w, 0);
+	for (int i=0; i<h; i++) {
+		const unsigned char *p = data + pitch*i;
+		int sum = 0;
+		for (int j=0; j<w; j++) {
+			sum += p[j];
+			colsum[j] += p[j];
+		}
+		row[i] = std::max(row[i], sum / w);
+	}
+	for (int j=0; j<w; j++) {
+		col[j] = std::max(col[j], colsum[j] / h);
+	}
+}
+
+// 黒帯の幅（左・上・右・下）を求める
+// 半分以上なくなる時は黒い映像とみなしてその方向は0
+inline void border_find(const int *row, const int *col, int w, int h, int *border) {
+	int top = 0, bottom = 0, left = 0, right = 0;
+	while (top < h && row[top] < BORDER_LUMA) top++;
+	while (bottom < h - top && row[h-1-bottom] < BORDER_LUMA) bottom++;
+	while (left < w && col[left] < BORDER_LUMA) left++;
+	while (right < w - left && col[w-1-right] < BORDER_LUMA) right++;
+	if (left + right > w / 2) left = right = 0;
+	if (top + bottom > h / 2) top = bottom = 0;
+	border[0] = left;
+	border[1] = top;
+	border[2] = right;
+	border[3] = bottom;
+}
+
+// [x0, x1)×[y0, y1)の外側がすべて黒帯の明るさか
+inline bool border_is_dark(const unsigned char *data, int pitch, int w, int h, int x0, int y0, int x1, int y1) {
+	for (int i=0; i<h; i++) {
+		const unsigned char *p = data + pitch*i;
+		if (i < y0 || i >= y1) {
+			int sum = 0;
+			for (int j=0; j<w; j++) {
+				sum += p[j];
+			}
+			if (sum / w >= BORDER_LUMA) {
+				return false;
+			}
+		}
+	}
+	if (x0 > 0 || x1 < w) {
+		std::vector<int> colsum(w, 0);
+		for (int i=0; i<h; i++) {
+			const unsigned char *p = data + pitch*i;
+			for (int j=0; j<x0; j++) {
+				colsum[j] += p[j];
+			}
+			for (int j=x1; j<w; j++) {
+				colsum[j] += p[j];
+			}
+		}
+		for (int j=0; j<w; j++) {
+			if ((j < x0 || j >= x1) && colsum[j] / h >= BORDER_LUMA) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+#endif
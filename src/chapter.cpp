@@ -0,0 +1,891 @@
+// chapter.cpp : 無音区間・シーンチェンジ検出処理
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <emmintrin.h>
+#include "chapter.h"
+#include "mvec.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#define sprintf_s sprintf
+#endif
+
+// --stats/--trace指定時のみ設定
+ChapterStats *g_stats = NULL;
+ChapterTrace *g_trace = NULL;
+
+
+// １フレーム分の無音判定
+bool audio_is_mute(const short *buf, int naudio, int mute) {
+	for (int j=0; j<naudio; ++j) {
+		if (abs(buf[j]) > mute) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// １フレーム分の音量最大値（audio_is_mute()は この値 <= mute と同じ）
+// 最小値・最大値をSSE2で求め、絶対値の大きい方
+int audio_peak(const short *buf, int naudio) {
+	int mn = 0, mx = 0;
+	int j = 0;
+	if (naudio >= 8) {
+		__m128i vmin = _mm_setzero_si128();
+		__m128i vmax = _mm_setzero_si128();
+		for (; j+8<=naudio; j+=8) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(buf + j));
+			vmin = _mm_min_epi16(vmin, v);
+			vmax = _mm_max_epi16(vmax, v);
+		}
+		short a[8], b[8];
+		_mm_storeu_si128((__m128i*)a, vmin);
+		_mm_storeu_si128((__m128i*)b, vmax);
+		for (int k=0; k<8; k++) {
+			if (a[k] < mn) mn = a[k];
+			if (b[k] > mx) mx = b[k];
+		}
+	}
+	for (; j<naudio; ++j) {
+		if (buf[j] < mn) mn = buf[j];
+		if (buf[j] > mx) mx = buf[j];
+	}
+	return (-mn > mx) ? -mn : mx;
+}
+
+// 32bit整数の最小値・最大値（SSE2にはpminsd/pmaxsdがないので比較して選ぶ）
+static inline __m128i min_epi32(__m128i a, __m128i b) {
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+static inline __m128i max_epi32(__m128i a, __m128i b) {
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+static inline void hminmax_epi32(__m128i vmin, __m128i vmax, int *mn, int *mx) {
+	int a[4], b[4];
+	_mm_storeu_si128((__m128i*)a, vmin);
+	_mm_storeu_si128((__m128i*)b, vmax);
+	for (int k=0; k<4; k++) {
+		if (a[k] < *mn) *mn = a[k];
+		if (b[k] > *mx) *mx = b[k];
+	}
+}
+
+// 32bit整数の最小値・最大値
+static void minmax_s32(const int32_t *buf, int n, int *mn, int *mx) {
+	int j = 0;
+	if (n >= 4) {
+		__m128i vmin = _mm_loadu_si128((const __m128i*)buf);
+		__m128i vmax = vmin;
+		for (j=4; j+4<=n; j+=4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(buf + j));
+			vmin = min_epi32(vmin, v);
+			vmax = max_epi32(vmax, v);
+		}
+		hminmax_epi32(vmin, vmax, mn, mx);
+	}
+	for (; j<n; j++) {
+		if (buf[j] < *mn) *mn = buf[j];
+		if (buf[j] > *mx) *mx = buf[j];
+	}
+}
+
+// 24bit整数の最小値・最大値（上位24bitに詰めた32bit値で比較）
+// SSE2には並べ替え（pshufb）がないので４サンプル分を４バイトずつ読んで詰める
+static void minmax_s24(const unsigned char *buf, int n, int *mn, int *mx) {
+	int j = 0;
+	if (n >= 5) {
+		__m128i vmin = _mm_set1_epi32(INT32_MAX);
+		__m128i vmax = _mm_set1_epi32(INT32_MIN);
+		// ４バイト目を読むので最後のサンプルは含めない
+		for (; j+5<=n; j+=4) {
+			const unsigned char *p = buf + j*3;
+			int32_t s0, s1, s2, s3;
+			memcpy(&s0, p, 4);
+			memcpy(&s1, p + 3, 4);
+			memcpy(&s2, p + 6, 4);
+			memcpy(&s3, p + 9, 4);
+			__m128i v = _mm_slli_epi32(_mm_set_epi32(s3, s2, s1, s0), 8);
+			vmin = min_epi32(vmin, v);
+			vmax = max_epi32(vmax, v);
+		}
+		hminmax_epi32(vmin, vmax, mn, mx);
+	}
+	for (; j<n; j++) {
+		const unsigned char *p = buf + j*3;
+		int32_t s = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+		if (s < *mn) *mn = s;
+		if (s > *mx) *mx = s;
+	}
+}
+
+// 浮動小数点の最小値・最大値
+static void minmax_float(const float *buf, int n, float *mn, float *mx) {
+	int j = 0;
+	if (n >= 4) {
+		__m128 vmin = _mm_loadu_ps(buf);
+		__m128 vmax = vmin;
+		for (j=4; j+4<=n; j+=4) {
+			__m128 v = _mm_loadu_ps(buf + j);
+			vmin = _mm_min_ps(vmin, v);
+			vmax = _mm_max_ps(vmax, v);
+		}
+		float a[4], b[4];
+		_mm_storeu_ps(a, vmin);
+		_mm_storeu_ps(b, vmax);
+		for (int k=0; k<4; k++) {
+			if (a[k] < *mn) *mn = a[k];
+			if (b[k] > *mx) *mx = b[k];
+		}
+	}
+	for (; j<n; j++) {
+		if (buf[j] < *mn) *mn = buf[j];
+		if (buf[j] > *mx) *mx = buf[j];
+	}
+}
+
+// 浮動小数点を16bitに換算（AviSynthのConvertAudioTo16bitと同じく32768倍して最近接に丸める）
+static inline int float_to_s16(float v) {
+	float f = v * 32768.0f;
+	if (f <= -32768.0f) return -32768;
+	if (f >= 32767.0f) return 32767;
+	return (int)lrintf(f);
+}
+
+// type形式の音声の音量最大値（16bitに換算）
+int audio_peak(const void *buf, int naudio, int type) {
+	int lo, hi;		// 16bitに換算した最小値・最大値
+	if (naudio <= 0) {
+		return 0;
+	}
+	switch (type) {
+	case AUDIO_S24:
+	case AUDIO_S32: {
+		int mn = INT32_MAX, mx = INT32_MIN;
+		if (type == AUDIO_S24) {
+			minmax_s24((const unsigned char*)buf, naudio, &mn, &mx);
+		} else {
+			minmax_s32((const int32_t*)buf, naudio, &mn, &mx);
+		}
+		lo = mn >> 16;
+		hi = mx >> 16;
+		break;
+	}
+	case AUDIO_FLOAT: {
+		float mn = 0, mx = 0;
+		minmax_float((const float*)buf, naudio, &mn, &mx);
+		lo = float_to_s16(mn);
+		hi = float_to_s16(mx);
+		break;
+	}
+	default:
+		return audio_peak((const short*)buf, naudio);
+	}
+	lo = abs(lo);
+	hi = abs(hi);
+	return (lo > hi) ? lo : hi;
+}
+
+bool audio_is_mute(const void *buf, int naudio, int mute, int type) {
+	if (type == AUDIO_S16) {
+		return audio_is_mute((const short*)buf, naudio, mute);
+	}
+	return audio_peak(buf, naudio, type) <= mute;
+}
+
+// 輝度データの動き検索（pictはFRAME_PICTURE/FIELD_PICTURE）
+void measure_scene(SceneInfo *si, unsigned char *cur, unsigned char *bef, int w, int h, int frame, const MvecRoi *roi, int pict) {
+	StatScope st(ST_MVEC);
+	TraceScope tr("mvec", "scene", frame);
+	si->rate_sc = mvec( &si->cmvec, &si->cmvec2, &si->flag_sc, cur, bef, w, h, (100-0)*(100/pict), pict, frame, roi);
+}
+
+// 区間内で動き検索が必要な範囲
+void scene_range(const ChapterParam &param, int n, int start_fr, int seri, int *range_start, int *range_end) {
+	*range_start = start_fr - param.extendmute - 1;
+	*range_end   = start_fr + seri + param.extendmute + 1;
+	if (*range_start < 0){
+		*range_start = 0;
+	}
+	if (*range_end >= n){
+		*range_end = n-1;
+	}
+}
+
+// 無音区間１つ分の処理（--stats集計・--trace記録付き）
+static void proc_interval(SceneReader *reader, SceneWriter *writer, SceneState *state,
+	const ChapterParam &param, int n, int start_fr, int seri)
+{
+	writer->write_mute(state->idx, start_fr, seri);
+	if (reader == NULL) {		// 無音区間のみ
+		state->idx++;
+		return;
+	}
+
+	//--- 区間内のシーンチェンジを取得 ---
+	if (g_stats) g_stats->begin_interval();
+	{
+		TraceScope tr("proc_scene_change", "scene", start_fr, state->idx);
+		proc_scene_change(reader, writer, state, param, n, start_fr, seri);
+	}
+	if (g_stats) {
+		int range_start, range_end;
+		scene_range(param, n, start_fr, seri, &range_start, &range_end);
+		g_stats->end_interval(state->idx, start_fr, seri, range_start - 1, range_end);
+	}
+
+	state->idx++;
+}
+
+// 全フレームの無音区間を検索し、区間ごとにシーンチェンジを取得・出力
+void search_chapter(MuteReader *audio, SceneReader *video, SceneWriter *writer,
+	const ChapterParam &param, int n, int thin_audio_read,
+	const ScanState *start, ScanCheckpoint *ckpt)
+{
+	ScanState st;
+	if (start) {
+		st = *start;
+	}
+	SceneState &state = st.scene;
+	int setseri = param.setseri;
+	int seri = st.seri;
+
+	for (int i=st.i; i<n-setseri-1; i++) {
+		if (ckpt) {
+			st.i = i;
+			st.seri = seri;
+			ckpt->update(st);
+		}
+		// searching foward frame
+		if (seri == 0 && thin_audio_read == THIN_GALLOP) {
+			// 直前(i-1)と i+setseri-1 が無音でなければ間の無音は setseri 未満なので読まずに進む
+			int q = i + setseri - 1;
+			if (q < n-setseri-1 && q > i) {
+				if (audio->is_mute(q) == false) {
+					i = q;
+					continue;
+				}
+				// 無音なら区間の先頭まで遡る（間に無音でないフレームがあればその次から）
+				int s = q;
+				while (s > i && audio->is_mute(s-1)) {
+					s--;
+				}
+				seri = q - s + 1;
+				i = q;
+				continue;
+			}
+		}
+		else if (seri == 0 && thin_audio_read > 0) {		// 間引きしながら無音確認
+			if (audio->is_mute(i+setseri-1) == false) {
+				i += setseri;
+			}
+		}
+
+		bool nomute = (audio->is_mute(i) == false);
+
+		//
+		if (nomute || i == n-1) {
+			// owata
+			if (seri >= setseri) {
+				int start_fr = i - seri;
+
+				proc_interval(video, writer, &state, param, n, start_fr, seri);
+			}
+			seri = 0;
+		} else {
+			seri++;
+		}
+	}
+}
+
+
+// search_chapter()で動き検索を行うフレームを列挙
+void list_scene_frames(MuteReader *audio, const ChapterParam &param, int n, std::vector<int> *frames) {
+	std::vector<char> need(n > 0 ? n : 0, 0);
+	int seri = 0;
+	for (int i=0; i<n-param.setseri-1; i++) {
+		if (audio->is_mute(i) == false) {
+			if (seri >= param.setseri) {
+				int range_start, range_end;
+				scene_range(param, n, i - seri, seri, &range_start, &range_end);
+				for (int x=range_start; x<=range_end; x++) {
+					need[x] = 1;
+				}
+			}
+			seri = 0;
+		} else {
+			seri++;
+		}
+	}
+	frames->clear();
+	for (int x=0; x<n; x++) {
+		if (need[x]) {
+			frames->push_back(x);
+		}
+	}
+}
+
+void ChapterStream::proc(const Pending &p) {
+	proc_interval(_reader, _writer, &_state, _param, _n, p.start_fr, p.seri);
+}
+
+void ChapterStream::add(bool mute) {
+	int x = _n++;
+	if (mute == false) {
+		if (_seri >= _param.setseri) {
+			Pending p;
+			p.start_fr = x - _seri;
+			p.seri = _seri;
+			p.end_fr = x;
+			_pending.push_back(p);
+		}
+		_seri = 0;
+	} else {
+		_seri++;
+	}
+}
+
+bool ChapterStream::scene_needed(int *from, int *to) {
+	int x = _n - 1;
+	if (_seri == _param.setseri && _seri > 0) {
+		// 区間になった時点で計算開始位置まで遡る
+		*from = x - _seri - _param.extendmute;
+		if (*from < 0) {
+			*from = 0;
+		}
+		*to = x;
+		return true;
+	}
+	if (_seri > _param.setseri ||
+		(_pending.empty() == false && x <= _pending.back().end_fr + _param.extendmute + 1)) {
+		*from = x;
+		*to = x;
+		return true;
+	}
+	return false;
+}
+
+int ChapterStream::scene_keep() {
+	int keep = _n - _seri - _param.extendmute - 1;
+	if (_pending.empty() == false) {
+		int range_start, range_end;
+		scene_range(_param, _n, _pending.front().start_fr, _pending.front().seri, &range_start, &range_end);
+		if (keep > range_start) {
+			keep = range_start;
+		}
+	}
+	return keep;
+}
+
+void ChapterStream::flush() {
+	// search_chapter()は最後の setseri+1 フレーム以降で終わる無音区間を対象外にするので、それまで待つ
+	int x = _n - 1;
+	while (_pending.empty() == false) {
+		const Pending &p = _pending.front();
+		if (x < p.end_fr + _param.extendmute + 1 || x < p.end_fr + _param.setseri + 1) {
+			break;
+		}
+		proc(p);
+		_pending.pop_front();
+	}
+}
+
+void ChapterStream::finish() {
+	while (_pending.empty() == false) {
+		const Pending &p = _pending.front();
+		if (p.end_fr < _n - _param.setseri - 1) {
+			proc(p);
+		}
+		_pending.pop_front();
+	}
+}
+
+
+// 区間内のシーンチェンジを取得・出力
+int proc_scene_change(
+	SceneReader *reader,			// 動き検索結果の取得元
+	SceneWriter *writer,			// 結果の出力先
+	SceneState *state,				// 区間をまたいで引き継ぐ状態（上書き更新）
+	const ChapterParam &param,		// 検索設定
+	int n,							// フレーム数
+	int start_fr,					// 開始フレーム番号
+	int seri						// 無音区間フレーム数
+){
+	const int space_sc1  = 5;		// シーンチェンジ間の最低フレーム間隔
+	const int space_sc2 = 10;		// シーンチェンジ間の最低フレーム間隔（位置上書きになる場合用１）
+	const int space_sc3 = 30;		// シーンチェンジ間の最低フレーム間隔（位置上書きになる場合用２）
+	const int THRES_RATE1 = 300;	// 明確なシーンチェンジ判定用の閾値
+	const int THRES_RATE2 = 7;		// 変化なし判定用の閾値
+	int setseri    = param.setseri;
+	int breakmute  = param.breakmute;
+	int extendmute = param.extendmute;
+	int idx = state->idx;
+	int *lastmute_scpos  = &state->lastmute_scpos;
+	int *lastmute_marker = &state->lastmute_marker;
+	int ncount_sc = 0;				// シーンチェンジ数カウント
+
+	//--- シーンチェンジ情報初期化 ---
+	int msel = 0;					// 何番目のシーンチェンジか（0-）
+	int d_max_en[DEF_SCMAX];		// シーンチェンジの有効性
+	int d_max_flagsc[DEF_SCMAX];	// シーンチェンジ判定フラグ
+	int d_max_pos[DEF_SCMAX];		// シーンチェンジ地点フレーム番号
+	int d_max_mvec[DEF_SCMAX];		// シーンチェンジ地点動き情報
+	int d_maxp_mvec[DEF_SCMAX];		// シーンチェンジ１フレーム前動き情報
+	int d_maxn_mvec[DEF_SCMAX];		// シーンチェンジ１フレーム後動き情報
+	int d_max_mvec2[DEF_SCMAX];		// シーンチェンジ地点インターレース用動き情報
+	int d_maxp_mvec2[DEF_SCMAX];	// シーンチェンジ１フレーム前インターレース用動き情報
+	int d_maxn_mvec2[DEF_SCMAX];	// シーンチェンジ１フレーム後インターレース用動き情報
+	int d_max_scrate[DEF_SCMAX];	// シーンチェンジ地点のシーンチェンジ判定値（0-100）
+
+	for(int k=0; k<DEF_SCMAX; k++){
+		d_max_en[k]     = 0;
+		d_max_flagsc[k] = 0;
+	}
+
+	//--- 個別シーンチェンジ位置情報取得 ---
+	{
+		//--- 位置情報設定 ---
+		int range_start_fr;										// 計算開始フレーム
+		int valid_start_fr = start_fr - extendmute;				// 検索開始フレーム
+		int range_end_fr;										// 計算終了フレーム
+		int valid_end_fr   = start_fr + seri + extendmute;		// 検索終了フレーム
+		scene_range(param, n, start_fr, seri, &range_start_fr, &range_end_fr);
+		if (valid_start_fr < 0){
+			valid_start_fr = 0;
+		}
+		if (valid_end_fr >= n){
+			valid_end_fr = n-1;
+		}
+
+		//--- ローカル変数 ---
+		int local_end_fr;				// シーンチェンジ確定フレーム位置
+		int local_cntsc;				// 指定期間内シーンチェンジ回数
+		int pos_lastchange;				// 前回変化位置
+		int skip_update;				// 連続フレームシーンチェンジ無視用
+		SceneInfo si;					// 動き検索結果
+		int cmvec;						// インターレースの動き多い側取得用
+		int cmvec2;						// インターレースの動き少ない側取得用
+		int rate_sc;					// シーンチェンジ判定値（flag_scの元となる値）
+		int flag_sc;					// シーンチェンジ判定フラグ
+		int flag_sc_hold = 0;			// 保持シーンチェンジ判定フラグ
+		int last_cmvec  = 0;			// 前フレームの動き情報記憶用
+		int last_cmvec2 = 0;			// 前フレームのインターレース用動き情報記憶用
+		int last_rate = 0;				// 直前のシーンチェンジ判定領域値
+		int keep_schk = 0;				// 直前シーンチェンジの保持観察フラグ
+		int keep_msel = 0;				// 直前シーンチェンジの保持位置
+
+		//--- 検索開始前設定 ---
+		local_cntsc = 0;						// 指定期間内シーンチェンジ回数
+		local_end_fr = start_fr + breakmute;	// 次のシーンチェンジ確定フレーム指定
+		pos_lastchange = -space_sc1;			// 前回変化位置
+		if (*lastmute_scpos > 0){				// 前回シーンチェンジが存在する場合
+			pos_lastchange = *lastmute_scpos;	// シーンチェンジ直後は間隔をあけるため
+		}
+
+		//--- 各フレーム画像データからシーンチェンジ情報を取得 ---
+		reader->set_range(range_start_fr, range_end_fr, seri > breakmute);
+		for (int x=range_start_fr; x<=range_end_fr; x++) {
+			//--- データ取得 ---
+			memset(&si, 0, sizeof(si));
+			reader->get_scene(x, &si);
+			rate_sc = si.rate_sc;
+			flag_sc = si.flag_sc;
+			cmvec   = si.cmvec;
+			cmvec2  = si.cmvec2;
+			if (d_max_en[msel] > 0){
+				if (x == d_max_pos[msel]+1){			// シーンチェンジ１フレーム後の動き情報更新
+					d_maxn_mvec[msel]  = cmvec;
+					d_maxn_mvec2[msel] = cmvec2;
+				}
+			}
+			//--- シーンチェンジ格納処理 ---
+			if (msel < DEF_SCMAX-1){							// 配列が埋まっていないこと前提
+				if (flag_sc_hold > 0){							// シーンチェンジ検出切り替え地点
+					if (local_cntsc < 1){						// 現地点を残してさらに候補追加可能な時
+						local_cntsc ++;
+						msel ++;
+						flag_sc_hold = 0;
+					}
+				}
+				if (x >= local_end_fr){			// 指定期間無音が続いた場合
+					if (local_cntsc == 0 && d_max_en[msel] > 0){	// シーンチェンジがなかったら確定
+						msel ++;
+					}
+					else if (flag_sc_hold > 0){		// シーンチェンジ確定
+						msel ++;
+					}
+					else{
+						d_max_en[msel] = 0;
+					}
+					local_end_fr += breakmute;	// 次のシーンチェンジ確定フレーム指定
+					local_cntsc = 0;			// 指定期間内シーンチェンジ回数
+					flag_sc_hold = 0;
+				}
+			}
+			//--- シーンチェンジ判定処理 ---
+			if (x < valid_start_fr || x > valid_end_fr){		// 検索範囲外
+			}
+			else{
+				//--- シーンチェンジ上書きになる場合の実行を判別 ---
+				if (flag_sc > 0 && d_max_flagsc[msel] > 0){			// シーンチェンジありで上書きになる場合
+//					printf("overwrite %d,%d,%d -> %d,%d,%d\n", d_max_pos[msel], d_max_mvec[msel], d_max_scrate[msel], x, cmvec, rate_sc);
+					if (abs(x - d_max_pos[msel]) <= space_sc2){ 	// 上書き前の位置から間隔が短い場合
+						if (d_max_scrate[msel] >= THRES_RATE1 ||	// 前回地点の画面転換割合が大きい場合無効化
+							rate_sc < THRES_RATE1 ||				// 今回地点の画面転換割合が小さい場合無効化
+							last_rate * 2 > rate_sc){				// 前画面から変化が大きくない場合無効化
+							flag_sc = 0;
+						}
+					}
+					if (abs(x - d_max_pos[msel]) <= space_sc3){		// 上書き前の位置から間隔が指定内の場合
+						if (d_max_scrate[msel] > rate_sc ||			// 前回より画面転換割合が小さい場合無効化
+							last_rate * 2 > rate_sc){				// 前画面から変化が大きくない場合無効化
+							flag_sc = 0;
+						}
+					}
+				}
+//if (x > 50108 && x < 50118){
+//printf("(%d %d %d %d %d)\n", x, flag_sc, rate_sc, last_rate, pos_lastchange);
+//}
+				//--- シーンチェンジ直後の再シーンチェンジ実行を判別 ---
+				// 原則シーンチェンジ検出直後は連続で保持しないよう間隔をあける
+				skip_update = 0;
+				if (abs(x - pos_lastchange) <= space_sc1 &&
+					x - pos_lastchange != 0){					// 前回シーンチェンジ付近のフレームは
+					skip_update = 1;							// 連続で保持しない（標準設定）
+					if (keep_schk > 0){							// 差し替え可能性から観察必要時
+						if (flag_sc > 0 &&						// 今回もシーンチェンジ
+							rate_sc >= THRES_RATE1 &&			// 画面転換割合が大きい
+							d_max_scrate[keep_msel] * 2 <= rate_sc &&	// 前回地点よりはるかに変化大
+							last_rate * 3 <= rate_sc){			// 前画面よりはるかに変化大
+							// 上記条件時は例外としてシーンチェンジ設定を行う（上書き設定）
+							skip_update = 0;
+							if (msel != keep_msel){				// 設定位置が変わっていたら戻す
+								msel = keep_msel;
+								if (local_cntsc > 0){			// カウントも増えていたら戻す
+									local_cntsc --;
+								}
+							}
+						}
+					}
+				}
+				else{											// シーンチェンジから離れたら
+					keep_schk = 0;								// 観察終了
+				}
+				//--- シーンチェンジ更新処理 ---
+				if (skip_update == 0){
+					int flag_rateup = 0;
+					if ((d_max_scrate[msel] < rate_sc && rate_sc >= THRES_RATE2) ||
+						(d_max_scrate[msel] == rate_sc && d_max_mvec[msel] < cmvec) ||
+						(d_max_scrate[msel] < THRES_RATE2 &&
+						 rate_sc < THRES_RATE2 && d_max_mvec[msel] < cmvec)){
+						flag_rateup = 1;
+					}
+					if ((d_max_flagsc[msel] == 0 && flag_rateup > 0)||
+							  d_max_en[msel] == 0 || flag_sc > 0) {		// シーンチェンジ地点更新
+						d_max_en[msel]     = 1;
+						d_max_pos[msel]    = x;
+						d_max_mvec[msel]   = cmvec;
+						d_maxp_mvec[msel]  = last_cmvec;
+						d_maxn_mvec[msel]  = 0;
+						d_max_mvec2[msel]  = cmvec2;
+						d_maxp_mvec2[msel] = last_cmvec2;
+						d_maxn_mvec2[msel] = 0;
+						d_max_scrate[msel] = rate_sc;
+						if (flag_sc > 0){			// シーンチェンジあり
+							flag_sc_hold = 1;
+							d_max_flagsc[msel] = 1;
+							pos_lastchange = x;						// シーンチェンジ直後は間隔をあけるため位置保持
+							if (rate_sc < THRES_RATE1){				// 画面転換量が少ない時は数フレーム要観察
+								keep_schk = 1;
+								keep_msel = msel;
+							}
+						}
+					}
+				}
+			}
+			//--- 次のフレーム準備 ---
+			last_cmvec  = cmvec;
+			last_cmvec2 = cmvec2;
+			last_rate = rate_sc;
+//if (x>=48889 && x<=48910) printf("[%d:%d,%d,%d,%d]", x,cmvec,rate_sc,d_max_mvec[msel],d_max_flagsc[msel]);
+//					if (x>=9265 && x<=9269){
+//						fprintf(fout, "(%d:%d)",x,cmvec);
+//					}
+		}
+
+		// ２箇所目以降でシーンチェンジがなかったら無効化
+		if (flag_sc_hold == 0 && msel > 0){
+			if (local_cntsc > 0 || (local_end_fr - breakmute + setseri > range_end_fr)){
+				d_max_en[msel] = 0;
+			}
+		}
+	}
+
+	//--- シーンチェンジ情報加工 ---
+	int d_maxpre_pos[DEF_SCMAX];		// シーンチェンジ前の位置
+	int d_maxrev_pos[DEF_SCMAX];		// シーンチェンジ後の位置
+	int msel_max = 0;					// 最大のシーンチェンジ選択
+	{
+		// add for searching last frame before changing scene
+		// シーンチェンジ前後のフレーム番号を取得（インターレース片側変化中を外す）
+		for(int k=0; k<=msel; k++){
+			if (d_max_en[k] > 0){
+				d_maxpre_pos[k] = d_max_pos[k] - 1;		// 通常は１フレーム前がシーンチェンジ前
+				if (d_max_mvec[k] < d_maxp_mvec[k] * 2 && d_maxp_mvec[k] > d_maxp_mvec2[k] * 2 &&
+					d_max_mvec[k] - d_max_mvec2[k] > d_max_mvec[k] / 16){
+					d_maxpre_pos[k] = d_max_pos[k] - 2;
+				}
+				d_maxrev_pos[k] = d_max_pos[k];			// 通常はシーンチェンジ地点がシーンチェンジ後
+				if (d_maxrev_pos[k] - d_maxpre_pos[k] < 2){
+					if (d_max_mvec[k] > d_max_mvec2[k] * 2 &&
+						d_max_mvec[k] < d_maxn_mvec[k] * 2 &&
+						d_maxn_mvec[k] - d_maxn_mvec2[k] > d_maxn_mvec[k] / 16 &&
+						(d_maxn_mvec[k] > d_maxn_mvec2[k] * 2 || d_max_mvec[k] < d_maxn_mvec2[k] * 2)){
+						d_maxrev_pos[k] = d_max_pos[k] + 1;
+					}
+				}
+				if (d_maxpre_pos[k] < 0){
+					d_maxpre_pos[k] = 0;
+				}
+				if (d_maxrev_pos[k] < 0){
+					d_maxrev_pos[k] = 0;
+				}
+			}
+		}
+		// 複数候補があり、かつ変化のないシーンチェンジがある場合は削除
+		if (msel >= 1){
+			// 最大変化位置確認（max_msel値も更新）
+			int d_tmpmax      = -1;
+			int rate_tmpmax   = -1;
+			for(int k=0; k<=msel; k++){
+				if (d_max_en[k] > 0){
+					if ((d_max_scrate[k] > rate_tmpmax) ||
+						(d_max_scrate[k] == rate_tmpmax && d_max_mvec[k] > d_tmpmax)){
+						msel_max = k;
+						rate_tmpmax = d_max_scrate[k];
+						d_tmpmax    = d_max_mvec[k];
+					}
+				}
+			}
+			// 最大変化位置を除き、変化のない候補は削除
+			for(int k=0; k<=msel; k++){
+				if (d_max_en[k] > 0){
+					if (d_max_scrate[k] < THRES_RATE2 && k != msel_max){
+						d_max_en[k] = 0;
+					}
+				}
+			}
+		}
+
+		// 最後のシーンチェンジ位置を記憶（次の無音区間のオーバーラップ検出用）
+		int tmp_scpos = -1;
+		int tmp_flagsc = 0;
+		for(int k=0; k<=msel; k++){
+			if (d_max_en[k] > 0){
+				if (tmp_scpos < d_max_pos[k]){
+					tmp_scpos  = d_max_pos[k];
+					tmp_flagsc = d_max_flagsc[k];
+				}
+			}
+		}
+		if (tmp_flagsc > 0){			// 最後が明確なシーンチェンジだった時のみ設定
+			*lastmute_scpos = tmp_scpos;
+		}
+		else{
+			*lastmute_scpos = -1;
+		}
+	}
+
+	//--- シーンチェンジ情報表示用 ---
+	{
+		// 長時間無音シーンチェンジ設定幅があるか確認
+		int flag_force_sc = 0;			// 指定期間内で強制的にシーンチェンジを行ったか
+		if (msel > 0){		// ２つ以上の間隔
+			int msel_s = -1;			// 最初の有効番号
+			int msel_e = -1;			// 最後の有効番号
+			for(int k=0; k<=msel; k++){
+				if (d_max_en[k] > 0){
+					msel_e = k;
+					if (msel_s < 0){
+						msel_s = k;
+					}
+				}
+			}
+			if (d_max_pos[msel_e] - d_max_pos[msel_s] > breakmute){
+				flag_force_sc = 1;
+			}
+		}
+
+		// マーク内容と位置を決める
+		int msel_mark = msel_max;
+		int msel_mknext  = msel_max;
+		int mark_type = 0;
+		int difmin = 30;
+		int last_frame;
+		if (*lastmute_marker < 0){					// 最初の無音の前回は無効
+			last_frame = -10000;
+		}
+		else{
+			last_frame = *lastmute_marker;
+		}
+		for(int k=0; k<=msel; k++){
+			if (d_max_en[k] == 0) continue;		// シーンチェンジ候補から外れた場合次に
+			int dif = abs(d_max_pos[k] - last_frame - 30*15);
+			if (dif < difmin){
+				difmin = dif;
+				msel_mark = k;
+				mark_type = 15;				// 15秒間隔
+			}
+			dif = abs(d_max_pos[k] - last_frame - 30*30);
+			if (dif < difmin){
+				difmin = dif;
+				msel_mark = k;
+				mark_type = 30;				// 30秒間隔
+			}
+			dif = abs(d_max_pos[k] - last_frame - 30*45);
+			if (dif < difmin){
+				difmin = dif;
+				msel_mark = k;
+				mark_type = 45;				// 45秒間隔
+			}
+			dif = abs(d_max_pos[k] - last_frame - 30*60);
+			if (dif < difmin){
+				difmin = dif;
+				msel_mark = k;
+				mark_type = 60;				// 60秒間隔
+			}
+			if (k == msel_mark){			// マーク位置更新時
+				msel_mknext = k;			// 次マーク起点も同様に更新
+			}
+			if (seri > breakmute){			// 無音期間が長い場合
+				if (k > msel_mark){			// マークから離れている場合
+					if (abs(d_max_pos[k] - d_max_pos[msel_mark]) > breakmute){
+						msel_mknext = k;	// 次マーク起点は最後の位置
+					}
+				}
+			}
+		}
+
+		//--- 結果表示 ---
+		for(int k=0; k<=msel; k++){
+			const char *mark = "";
+			if (d_max_en[k] == 0) continue;		// シーンチェンジ候補から外れた場合次に
+
+			if (d_max_scrate[k] < THRES_RATE2){	// 全く変化のないシーンチェンジ
+				mark = "＿";
+			}
+			else if ((flag_force_sc > 0 && (k != msel_mark || mark_type == 0)) ||	// 指定無音区間内シーンチェンジ地点
+					  (d_max_scrate[k] < THRES_RATE2 && k != msel_max)){			// 動きなしで残っている場合
+				mark = "○";
+			}
+			else if (k == msel_mark){
+				if (idx > 1 && mark_type == 15) {
+					mark = "★";
+				} else if (idx > 1 && mark_type == 30) {
+					mark = "★★";
+				} else if (idx > 1 && mark_type == 45) {
+					mark = "★★★";
+				} else if (idx > 1 && mark_type == 60) {
+					mark = "★★★★";
+				}
+			}
+			else{	// 無音区間内で第2候補シーンチェンジ
+					mark = "＠";
+			}
+			ncount_sc ++;
+
+			ScenePos sp;
+			sp.idx      = idx;
+			sp.start_fr = start_fr;
+			sp.seri     = seri;
+			sp.pos      = d_max_pos[k];
+			sp.rev_pos  = d_maxrev_pos[k];
+			sp.pre_pos  = d_maxpre_pos[k];
+			sp.rate     = d_max_scrate[k];
+			sp.mark     = mark;
+			writer->write_scpos(sp);
+		}
+		*lastmute_marker = d_max_pos[msel_mknext];
+	}
+	return ncount_sc;			// 検出した位置の合計を返す
+}
+
+// 通常の出力
+void write_chapter(FILE *f, int nchap, int frame, const char *title, int rate, int scale) {
+  int64_t t,h,m;
+	double s;
+	StatScope st(ST_OUTPUT);
+	TraceScope tr("write_chapter", "output", frame, nchap);
+
+	t = (int64_t)frame * 10000000 * scale / rate;
+	h = t / 36000000000;
+	m = (t - h * 36000000000) / 600000000;
+	s = (t - h * 36000000000 - m * 600000000) / 10000000.0;
+
+	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f\n", nchap, (int)h, (int)m, s);
+	fprintf(f, "CHAPTER%02dNAME=%s\n", nchap, title);
+	fflush(f);
+}
+// 解析用の出力
+void write_chapter_debug(FILE *f, int nchap, int frame, const char *title, int rate, int scale) {
+	int64_t t,h,m;
+	double s;
+	StatScope st(ST_OUTPUT);
+	TraceScope tr("write_chapter", "output", frame, nchap);
+
+	t = (int64_t)frame * 10000000 * scale / rate;
+	h = t / 36000000000;
+	m = (t - h * 36000000000) / 600000000;
+	s = (t - h * 36000000000 - m * 600000000) / 10000000.0;
+
+	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f from:%d\n", nchap, (int)h, (int)m, s, frame);   // add "from:%d" for debug
+//	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f\n", nchap, (int)h, (int)m, s);
+	fprintf(f, "CHAPTER%02dNAME=%s\n", nchap, title);
+	fflush(f);
+}
+
+void ChapterFileWriter::write_mute(int idx, int start_fr, int seri) {
+	fprintf(stderr,"mute%2d: %d - %dフレーム\n", idx, start_fr, seri);
+}
+
+void ChapterFileWriter::write_scpos(const ScenePos &sp) {
+	printf("\t SCPos: %d %s\n", sp.pos, sp.mark);
+
+	char title[256];
+	sprintf_s(title, "%dフレーム %s SCPos:%d %d", sp.seri, sp.mark, sp.rev_pos, sp.pre_pos);
+	if (_debug == 0){		// normal
+		write_chapter(_f, sp.idx, sp.start_fr, title, _rate, _scale);
+	}
+	else{					// for debug
+		char tmp_title[256];
+		sprintf_s(tmp_title, " Rate:%d", sp.rate);
+		strcat(title, tmp_title);
+		write_chapter_debug(_f, sp.idx, sp.start_fr, title, _rate, _scale);
+	}
+}
+
+void MuteFileWriter::write_mute(int idx, int start_fr, int seri) {
+	fprintf(stderr,"mute%2d: %d - %dフレーム\n", idx, start_fr, seri);
+
+	char title[256];
+	sprintf_s(title, "%dフレーム", seri);
+	if (_debug == 0){
+		write_chapter(_f, idx, start_fr, title, _rate, _scale);
+	}
+	else{
+		write_chapter_debug(_f, idx, start_fr, title, _rate, _scale);
+	}
+}
+
+void ChapterFileWriter::write_end(int n) {
+	StatScope st(ST_OUTPUT);
+	TraceScope tr("write_last_scpos", "output", n-1);
+	fprintf(_f, "# SCPos:%d %d\n", n-1, n-1);
+}
@@ -0,0 +1,249 @@
+// 無音区間・シーンチェンジ検出処理（CLIとlibchapterexeで共通）
+// 画像・音声の取得元と結果の出力先はクラスで受け渡しし、ファイルやAviSynthには依存しない。
+#ifndef __CHAPTER__
+#define __CHAPTER__
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include "mvec.h"
+
+// １回の無音期間内に保持する最大シーンチェンジ数
+#define DEF_SCMAX 100
+
+// search_chapter()のthin_audio_read：無音でない間はsetseriフレームおきに１フレームだけ読む（--gallop）
+#define THIN_GALLOP 3
+
+// 音声サンプルの形式
+enum {
+	AUDIO_S16 = 0,		// 16bit整数
+	AUDIO_S24,			// 24bit整数（3バイト詰め）
+	AUDIO_S32,			// 32bit整数
+	AUDIO_FLOAT,		// 32bit浮動小数点（±1.0）
+};
+
+// 検索設定
+struct ChapterParam {
+	int setmute;		// 無音判定閾値
+	int setseri;		// 最低無音フレーム数
+	int breakmute;		// 無音シーン検索間隔フレーム数
+	int extendmute;		// 無音前後検索拡張フレーム数
+};
+
+// 動き検索の設定（フレームごとの検索結果を変える設定）
+// SceneParam::pictureで開始前に判定する
+#define PICTURE_AUTO 0
+
+struct SceneParam {
+	int roi;			// 黒帯を検索対象から外す（--roi）
+	int roi_found;		// 検出済みの黒帯（1=roi_areaを使う -1=黒帯なし 0=読み込みごとに検出）
+	MvecRoi roi_area;
+	int coarse;			// 長い無音区間で同じ画像の組は前回の動き検索結果を使う（--coarse）
+	int picture;		// 動き検索の画像構造（--picture、FRAME_PICTURE/FIELD_PICTURE/PICTURE_AUTO）
+	SceneParam() : roi(0), roi_found(0), coarse(0), picture(FIELD_PICTURE) {
+		roi_area.x0 = roi_area.y0 = roi_area.x1 = roi_area.y1 = 0;
+	}
+};
+
+// １フレーム分の動き検索結果（frameとframe-1の比較、frame=0の時は自身と比較）
+struct SceneInfo {
+	int rate_sc;		// シーンチェンジ判定値
+	int flag_sc;		// シーンチェンジ判定フラグ
+	int cmvec;			// インターレースの動き多い側
+	int cmvec2;			// インターレースの動き少ない側
+};
+
+// 検出したシーンチェンジ１件分
+struct ScenePos {
+	int idx;			// 無音区間通算番号
+	int start_fr;		// 無音開始フレーム
+	int seri;			// 無音フレーム数
+	int pos;			// シーンチェンジ地点フレーム番号
+	int rev_pos;		// シーンチェンジ後の位置
+	int pre_pos;		// シーンチェンジ前の位置
+	int rate;			// シーンチェンジ判定値
+	const char *mark;	// マーク（UTF-8）
+};
+
+// 無音判定の取得元
+class MuteReader {
+public:
+	virtual ~MuteReader() { }
+	// frameが無音ならtrue
+	virtual bool is_mute(int frame) = 0;
+};
+
+// 動き検索結果の取得元
+class SceneReader {
+public:
+	virtual ~SceneReader() { }
+	// frameの動き検索結果を取得
+	virtual bool get_scene(int frame, SceneInfo *si) = 0;
+	// これから[start, end]を順に取得する（long_muteはbreakmuteより長い無音区間）
+	virtual void set_range(int start, int end, bool long_mute) { }
+};
+
+// 検出結果の出力先
+class SceneWriter {
+public:
+	virtual ~SceneWriter() { }
+	// 無音区間の検出
+	virtual void write_mute(int idx, int start_fr, int seri) { }
+	// シーンチェンジの検出
+	virtual void write_scpos(const ScenePos &sp) = 0;
+};
+
+// 無音区間をまたいで引き継ぐ状態
+struct SceneState {
+	int lastmute_scpos;		// -eオプションの検索オーバーラップを考慮して前回位置保持
+	int lastmute_marker;	// マーク表示用の起点位置保持
+	int idx;				// 次の無音区間通算番号
+	SceneState() : lastmute_scpos(-1), lastmute_marker(-1), idx(1) { }
+};
+
+// 無音判定の結果表
+class MuteTable : public MuteReader {
+public:
+	std::vector<char> mute;
+
+	bool is_mute(int frame) {
+		return mute[frame] != 0;
+	}
+};
+
+// 動き検索の結果表
+class SceneTable : public SceneReader {
+public:
+	std::vector<SceneInfo> scene;
+	std::vector<char> valid;
+
+	bool get_scene(int frame, SceneInfo *si) {
+		if (valid[frame] == 0) {
+			return false;
+		}
+		*si = scene[frame];
+		return true;
+	}
+};
+
+// search_chapter()の途中状態（ループ先頭での値、--resume用）
+struct ScanState {
+	int i;					// 次に確認するフレーム
+	int seri;				// 無音フレーム数
+	SceneState scene;
+	ScanState() : i(0), seri(0) { }
+};
+
+// search_chapter()の途中状態の保存先
+class ScanCheckpoint {
+public:
+	virtual ~ScanCheckpoint() { }
+	// ループ先頭ごとに呼ばれる（出力済みの内容と一致する状態、保存するかは実装側で判断）
+	virtual void update(const ScanState &st) = 0;
+};
+
+// １フレーム分の無音判定（先頭naudio個の値で判定）
+bool audio_is_mute(const short *buf, int naudio, int mute);
+
+// １フレーム分の音量最大値（先頭naudio個の値）
+int audio_peak(const short *buf, int naudio);
+
+// type形式の音声の無音判定・音量最大値（16bitに換算した値、muteも16bitの値）
+// 16bitへの換算は上位16bit（浮動小数点は32768倍して最近接に丸める）で、ConvertAudioTo16bitで
+// 16bitに変換してから判定した時と同じ（check/run_check.shのbasic_s24・basic_s32・basic_floatで確認）
+bool audio_is_mute(const void *buf, int naudio, int mute, int type);
+int audio_peak(const void *buf, int naudio, int type);
+
+// 輝度データ（幅w・高さhは16の倍数、ピッチw）の動き検索（roiを指定した時はその範囲のブロックのみ）
+void measure_scene(SceneInfo *si, unsigned char *cur, unsigned char *bef, int w, int h, int frame, const MvecRoi *roi = NULL,
+	int pict = FIELD_PICTURE);
+
+// 区間内で動き検索が必要な範囲
+void scene_range(const ChapterParam &param, int n, int start_fr, int seri, int *range_start, int *range_end);
+
+// 区間内のシーンチェンジを取得・出力
+int proc_scene_change(SceneReader *reader, SceneWriter *writer, SceneState *state,
+	const ChapterParam &param, int n, int start_fr, int seri);
+
+// 全フレームの無音区間を検索し、区間ごとにシーンチェンジを取得・出力
+// thin_audio_read > 0 の時は無音でない間はsetseriフレームおきに確認する
+// THIN_GALLOPの時は無音でない間はsetseriフレームおきの１フレームのみ確認し、無音なら区間の先頭まで遡る
+// startを指定した時はその状態から再開し、ckptを指定した時は途中状態を渡す
+// videoがNULLの時は無音区間のみ出力する（シーンチェンジは検索しない）
+void search_chapter(MuteReader *audio, SceneReader *video, SceneWriter *writer,
+	const ChapterParam &param, int n, int thin_audio_read,
+	const ScanState *start = NULL, ScanCheckpoint *ckpt = NULL);
+
+// search_chapter()で動き検索を行うフレームを昇順に列挙（全フレームの無音判定が必要）
+void list_scene_frames(MuteReader *audio, const ChapterParam &param, int n, std::vector<int> *frames);
+
+// フレームごとの無音判定を順に受け取り、確定した無音区間から処理する
+// 最後まで受け取った時の結果はsearch_chapter()と同じになる。
+// 無音区間は終了後 max(setseri, extendmute)+1 フレームを受け取った時点で確定する。
+class ChapterStream {
+	// 確定待ちの無音区間
+	struct Pending {
+		int start_fr;		// 無音開始フレーム
+		int seri;			// 無音フレーム数
+		int end_fr;			// 無音の次のフレーム（音あり）
+	};
+
+	ChapterParam _param;
+	SceneReader *_reader;
+	SceneWriter *_writer;
+	SceneState _state;
+	std::deque<Pending> _pending;
+	int _n;					// 受け取ったフレーム数
+	int _seri;				// 現在の無音フレーム数
+
+	void proc(const Pending &p);
+public:
+	ChapterStream(const ChapterParam &param, SceneReader *reader, SceneWriter *writer)
+		: _param(param), _reader(reader), _writer(writer), _n(0), _seri(0) { }
+
+	int frames() const { return _n; }
+
+	// 次のフレームの無音判定を追加
+	void add(bool mute);
+	// 最後に追加したフレームで動き検索が新たに必要になった範囲（無ければfalse）
+	bool scene_needed(int *from, int *to);
+	// 今後の区間で動き検索結果を使う最初のフレーム
+	int scene_keep();
+	// 確定した無音区間を処理
+	void flush();
+	// 入力終了（残りの無音区間を確定させる）
+	void finish();
+};
+
+// chapter.auf形式の出力
+void write_chapter(FILE *f, int nchap, int frame, const char *title, int rate, int scale);
+// 解析用の出力
+void write_chapter_debug(FILE *f, int nchap, int frame, const char *title, int rate, int scale);
+
+// chapter.auf形式でファイルに出力
+class ChapterFileWriter : public SceneWriter {
+	FILE *_f;
+	int _rate, _scale;
+	int _debug;
+public:
+	ChapterFileWriter(FILE *f, int rate, int scale, int debug) : _f(f), _rate(rate), _scale(scale), _debug(debug) { }
+
+	void write_mute(int idx, int start_fr, int seri);
+	void write_scpos(const ScenePos &sp);
+	// 最終フレーム番号を出力（改造版で追加）
+	void write_end(int n);
+};
+
+// 無音区間のみをchapter.auf形式でファイルに出力（SCPosなし、--silence-only）
+class MuteFileWriter : public SceneWriter {
+	FILE *_f;
+	int _rate, _scale;
+	int _debug;
+public:
+	MuteFileWriter(FILE *f, int rate, int scale, int debug) : _f(f), _rate(rate), _scale(scale), _debug(debug) { }
+
+	void write_mute(int idx, int start_fr, int seri);
+	void write_scpos(const ScenePos &sp) { }
+};
+
+#endif
@@ -3,72 +3,384 @@
 
 #include "source.h"
 #include "faw.h"
+#include "synthetic.h"
+#include "chapter.h"
+#include "source_reader.h"
+#include "checkpoint.h"
+#include "shard.h"
+#include "partial.h"
+#include "sweep.h"
+#include "peak.h"
+#include "picture.h"
+#include "index.h"
 #include <stdint.h>
 
 #ifndef _WIN32
-#define sprintf_s sprintf
+#include <unistd.h>
 #define _stricmp  strcasecmp
-#include <malloc.h>
+#define Sleep(ms) usleep((ms) * 1000)
 int fopen_s(FILE **fp,const char *s,const char *m)
 {
 *fp = fopen(s,m);
 return *fp == NULL;
 }
-#define _aligned_malloc(a,b) memalign(b,a)
-#define _aligned_free free
 #endif
+// 画像ソースを開く（optはAviSynthの読み込み設定）
+static Source *open_video(const char *avsv, const AvsOption &opt) {
+	if (SyntheticSource::is_synthetic(avsv)) {
+		// 合成ソース（動作確認用）
+		SyntheticSource *syn = new SyntheticSource();
+		syn->init(avsv);
+		return syn;
+	}
+	AvsSource *srcv = new AvsSource();
+	srcv->set_option(opt);
+	srcv->init(avsv);
+	if (srcv->has_video() == false) {
+		srcv->release();
+		throw "Error: No Video Found!";
+	}
+	return srcv;
+}
+
+// 音声ソースを開く（sameに音声があればそれを共有、別の*.avsならvideoのAviSynth環境を共有）
+static Source *open_audio(const char *avsa, Source *same, int rate, int scale, int memory_max = 0, Source *video = NULL) {
+	if (same && same->has_audio()) {
+		same->add_ref();
+		return same;
+	}
+
+	// 音声が別ファイルの時
+	Source *audio = NULL;
+	if (SyntheticSource::is_synthetic(avsa)) {
+		// 合成ソース（動作確認用）
+		SyntheticSource *syn = new SyntheticSource();
+		syn->init(avsa);
+		audio = syn;
+	} else if (strlen(avsa) > 4 && _stricmp(".wav", avsa + strlen(avsa) - 4) == 0) {
+		// wav
+		WavSource *wav = new WavSource();
+		wav->init(avsa);
+		if (wav->has_audio()) {
+			audio = wav;
+		} else {
+			wav->release();
+		}
+	} else {
+		// aui
+		AvsSource *aud = new AvsSource();
+		AvsSource *avsv = dynamic_cast<AvsSource*>(video);
+		if (avsv) {
+			aud->share_env(avsv->get_env());
+		}
+		AvsOption opt;
+		opt.memory_max = memory_max;
+		opt.audio_only = true;
+		aud->set_option(opt);
+		aud->init(avsa);
+		if (aud->has_audio()) {
+			audio = aud;
+		} else {
+			aud->release();
+		}
+	}
 
-// mvec.c
-#define FRAME_PICTURE	1
-#define FIELD_PICTURE	2
-int mvec(int *mvec1,int *mvec2,int *flag_sc,unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int threshold,int pict_struct, int nframe);
+	if (audio == NULL) {
+		throw "Error: No Audio!";
+	}
+	// rateが0の時はソースのフレームレートのまま
+	if (rate > 0) {
+		audio->set_rate(rate, scale);
+	}
+	return audio;
+}
 
-// １回の無音期間内に保持する最大シーンチェンジ数
-#define DEF_SCMAX 100
+// 先頭フレームにFAWがあればデコードするソースに差し替える
+// 確認で読んだフレームはcacheに保存する（差し替え前のソースの音声、差し替えた時はFAWDecoderが使う）
+static bool check_faw(Source **audio, int n, AudioFrameCache *cache) {
+	// FAWは16bitの音声にしか入っていない
+	if (audio_sample_type(*audio) != AUDIO_S16) {
+		return false;
+	}
+	std::vector<short> buf(AUDIO_BUF_SIZE);
+	const WAVEFORMATEX *fmt = (*audio)->get_input_info().audio_format;
+	int block = fmt ? fmt->nBlockAlign : 0;
+	CFAW cfaw;
+	int faws = 0;
+
+	for (int i=0; i<min(90, n); i++) {
+		StatScope st(ST_AUDIO);
+		int naudio = read_audio(*audio, i, &buf[0]);
+		if (block > 0) {
+			cache->add(&buf[0], naudio, naudio * block);
+		}
+		int j = cfaw.findFAW(&buf[0], naudio);
+		if (j != -1) {
+			cfaw.decodeFAW(&buf[j], naudio-j, &buf[0]); // test decode
+			faws++;
+		}
+	}
+	if (faws > 5) {
+		if (cfaw.isLoadFailed()) {
+			printf("  Error: FAW detected, but no FAWPreview.auf.\n");
+		} else {
+			printf("  FAW detected.\n");
+			*audio = new FAWDecoder(*audio, cache);
+			return true;
+		}
+	}
+	return false;
+}
 
-int proc_scene_change(
-	Source *video,int *lastmute_scpos,int *lastmute_marker,FILE *fout,unsigned char *pix0,unsigned char *pix1,
-	int w,int h,int start_fr,int seri,int setseri,int breakmute,int extendmute,int debug,int idx);
+// --shards用に同じ入力を開き直す（インスタンスごとのメモリ上限付き）
+class InputFactory : public SourceFactory {
+	const char *_avsv;
+	const char *_avsa;
+	int _rate, _scale;
+	bool _faw;
+	AvsOption _opt;
+public:
+	InputFactory(const char *avsv, const char *avsa, int rate, int scale, bool faw, const AvsOption &opt)
+		: _avsv(avsv), _avsa(avsa), _rate(rate), _scale(scale), _faw(faw), _opt(opt) { }
+
+	void create(Source **video, Source **audio) {
+		*video = open_video(_avsv, _opt);
+		try {
+			// 同じソースの場合は同じインスタンスで読み込む
+			*audio = open_audio(_avsa, (strcmp(_avsv, _avsa) == 0) ? *video : NULL, _rate, _scale, _opt.memory_max, *video);
+		} catch (...) {
+			(*video)->release();
+			throw;
+		}
+		if (_faw) {
+			*audio = new FAWDecoder(*audio);
+		}
+	}
+};
+
+// --audio-threads用に音声のみ開き直す
+class AudioFactory : public SourceFactory {
+	const char *_avsa;
+	int _rate, _scale;
+	bool _faw;
+	int _memory_max;
+public:
+	AudioFactory(const char *avsa, int rate, int scale, bool faw, int memory_max)
+		: _avsa(avsa), _rate(rate), _scale(scale), _faw(faw), _memory_max(memory_max) { }
+
+	void create(Source **video, Source **audio) {
+		*video = NULL;
+		*audio = open_audio(_avsa, NULL, _rate, _scale, _memory_max);
+		if (_faw) {
+			*audio = new FAWDecoder(*audio);
+		}
+	}
+};
 
+// 全フレームの音量最大値を複数スレッドで求めてから無音判定・検索（--audio-threads）
+static void search_peak_chapter(const char *avsa, int rate, int scale, bool faw, int memory_max, int nthread,
+	SceneReader *sreader, SceneWriter *writer, const ChapterParam &param, int n)
+{
+	if (memory_max <= 0) {
+		memory_max = POOL_MEMORY_MB;
+	}
+	AudioFactory factory(avsa, rate, scale, faw, memory_max);
+	SourcePool pool(&factory, nthread);
+	std::vector<int> peak;
+	PeakScanner scanner(&pool, n, nthread);
+	scanner.run(&peak);
+	PeakMuteReader mreader(peak, param.setmute);
+	search_chapter(&mreader, sreader, writer, param, n, -1);
+}
 
-// 通常の出力
-void write_chapter(FILE *f, int nchap, int frame, char *title, INPUT_INFO *iip) {
-  int64_t t,h,m;
-	double s;
+// --follow時の確認間隔（ミリ秒）
+#define FOLLOW_POLL_MS 500
 
-	t = (int64_t)frame * 10000000 * iip->scale / iip->rate;
-	h = t / 36000000000;
-	m = (t - h * 36000000000) / 600000000;
-	s = (t - h * 36000000000 - m * 600000000) / 10000000.0;
+// 追記中のファイルを読み込める所まで順に解析し、timeout秒間増えなければ終了
+// 戻り値は最終的なフレーム数
+static int follow_chapter(Source *video, Source *audio, MuteReader *mreader, SceneReader *sreader, SceneWriter *writer,
+	const ChapterParam &param, double timeout)
+{
+	ChapterStream stream(param, sreader, writer);
 
-	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f\n", nchap, (int)h, (int)m, s);
-	fprintf(f, "CHAPTER%02dNAME=%s\n", nchap, title);
-	fflush(f);
+	double last_grow = stat_clock(CLOCK_MONOTONIC);
+	for (;;) {
+		int n = video->refresh();
+		if (audio != video) {
+			n = min(n, audio->refresh());
+		}
+		if (n > stream.frames()) {
+			if (g_stats) g_stats->extend_frames(n);
+			while (stream.frames() < n) {
+				stream.add(mreader->is_mute(stream.frames()));
+				stream.flush();
+			}
+			last_grow = stat_clock(CLOCK_MONOTONIC);
+		} else if (stat_clock(CLOCK_MONOTONIC) - last_grow >= timeout) {
+			break;
+		} else {
+			Sleep(FOLLOW_POLL_MS);
+		}
+	}
+	stream.finish();
+	return stream.frames();
 }
-// 解析用の出力
-void write_chapter_debug(FILE *f, int nchap, int frame, char *title, INPUT_INFO *iip) {
-	int64_t t,h,m;
-	double s;
-
-	t = (int64_t)frame * 10000000 * iip->scale / iip->rate;
-	h = t / 36000000000;
-	m = (t - h * 36000000000) / 600000000;
-	s = (t - h * 36000000000 - m * 600000000) / 10000000.0;
-
-	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f from:%d\n", nchap, (int)h, (int)m, s, frame);   // add "from:%d" for debug
-//	fprintf(f, "CHAPTER%02d=%02d:%02d:%06.3f\n", nchap, (int)h, (int)m, s);
-	fprintf(f, "CHAPTER%02dNAME=%s\n", nchap, title);
-	fflush(f);
+
+// --silence-only で指定がなくソースにもない時のフレームレート
+#define SILENCE_DEF_RATE 30000
+#define SILENCE_DEF_SCALE 1001
+
+// 音声のみ開いて無音区間を出力（--silence-only、画像は開かない）
+// rateが0の時は音声ソースのフレームレート（ない時は29.97fps）
+static int silence_main(const char *avsa, const char *out, const ChapterParam &param, int thin_audio_read,
+	int rate, int scale, const char *stats, const char *trace, double stats_interval, int debug, int memory_max,
+	int audio_threads)
+{
+	Source *audio = NULL;
+	try {
+		audio = open_audio(avsa, NULL, rate, scale, memory_max);
+	} catch(const char *s) {
+		printf("%s\n", s);
+		return -1;
+	}
+	INPUT_INFO &aii = audio->get_input_info();
+	if (aii.rate <= 0 || aii.scale <= 0) {
+		audio->set_rate(SILENCE_DEF_RATE, SILENCE_DEF_SCALE);
+	}
+	// 画像のあるソースは画像と同じフレーム数（通常の解析と同じ範囲）
+	int n = audio->has_video() ? aii.n : audio->refresh();
+
+	FILE *fout;
+	if (fopen_s(&fout, out, "w") != 0) {
+		printf("Error: output file open failed.\n");
+		audio->release();
+		return -1;
+	}
+
+	fprintf(stderr, "Audio data\n");
+	fprintf(stderr, "\tFrames: %d [%.02ffps]\n", n, (double)aii.rate / aii.scale);
+	fprintf(stderr, "\tAudio Samples: %d [%dHz]\n", aii.audio_n, aii.audio_format->nSamplesPerSec);
+
+	if (stats) {
+		g_stats = new ChapterStats(stats);
+		g_stats->audio = avsa;
+		g_stats->fps = (double)aii.rate / aii.scale;
+		g_stats->set_frames(n);
+		g_stats->set_interval(stats_interval);
+	}
+	if (trace) {
+		g_trace = new ChapterTrace(trace);
+	}
+
+	AudioFrameCache cache;
+	bool faw = check_faw(&audio, n, &cache);
+	bool failed = false;
+
+	if (audio_threads > 1) {
+		printf("read audio : silence only, %d threads\n", audio_threads);
+	} else {
+		printf("read audio : silence only\n");
+	}
+	printf("--------\nStart searching...\n");
+	{
+		MuteFileWriter writer(fout, aii.rate, aii.scale, debug);
+		if (audio_threads > 1) {
+			try {
+				search_peak_chapter(avsa, aii.rate, aii.scale, faw, memory_max, audio_threads,
+					NULL, &writer, param, n);
+			} catch (const char *s) {
+				printf("%s\n", s);
+				failed = true;
+			} catch (const AvisynthError &err) {
+				printf("Avisynth ERROR: %s\n", err.msg);
+				failed = true;
+			}
+		} else {
+			SourceMuteReader mreader(audio, param.setmute);
+			if (faw == false) {
+				mreader.set_cache(&cache);
+			}
+			search_chapter(&mreader, NULL, &writer, param, n, thin_audio_read);
+		}
+		fprintf(stderr,"end\n");
+	}
+	fclose(fout);
+	if (failed) {
+		audio->release();
+		return -1;
+	}
+
+	if (g_stats) {
+		g_stats->write(true, n);
+		delete g_stats;
+		g_stats = NULL;
+	}
+	if (g_trace) {
+		g_trace->write();
+		delete g_trace;
+		g_trace = NULL;
+	}
+	audio->release();
+	return 0;
+}
+
+// 値を取らないオプション（引数の最後に置いてもよい）
+static bool is_flag_option(const char *s) {
+	static const char *flags[] = { "--debug", "--thin", "--serial", "--gallop", "--resume", "--silence-only",
+		"--coarse", "--roi", "--avs-luma", NULL };
+	for (int k=0; flags[k]; k++) {
+		if (strcmp(s, flags[k]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// 部分ファイルの結合（chapter_exe merge -o 出力 部分ファイル...）
+static int merge_main(int argc, const char* argv[]) {
+	const char *out = NULL;
+	std::vector<const char*> parts;
+	for (int i=0; i<argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+			out = argv[++i];
+		} else {
+			parts.push_back(argv[i]);
+		}
+	}
+	if (out == NULL) {
+		printf("error: no output file path!\n");
+		return -1;
+	}
+	return PartialResult::merge(out, parts);
 }
 
 int main(int argc, const char* argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "merge") == 0) {
+		return merge_main(argc - 2, argv + 2);
+	}
 
 	printf("chapter.auf pre loading program.\n");
 	printf("usage:\n");
 	printf("\tchapter_exe.exe -v input_avs -o output_txt\n");
 	printf("params:\n\t-v 入力画像ファイル\n\t-a 入力音声ファイル（省略時は動画と同じファイル）\n\t-m 無音判定閾値（1〜2^15)\n\t-s 最低無音フレーム数\n\t-b 無音シーン検索間隔数\n");
 	printf("\t-e 無音前後検索拡張フレーム数\n");
+	printf("\t--stats 処理時間・回数の集計結果(JSON)出力先\n\t--stats-interval 集計結果の途中出力間隔（秒）\n");
+	printf("\t--trace 処理区間のタイムライン(Chrome trace形式)出力先\n");
+	printf("\t--follow 録画中のファイルを追いかけて解析（指定秒数増えなければ終了）\n");
+	printf("\t--shards 時間分割して並列に解析する数\n");
+	printf("\t--index 全フレームの動き検索結果(バイナリ)出力先（--shards省略時はCPU数で並列に解析）\n");
+	printf("\t--range start:end 指定範囲のみ解析して部分ファイルを出力（chapter_exe merge -o 出力 部分ファイル... で結合）\n");
+	printf("\t--set m,s,b,e 出力先 追加の検索設定（空欄は-m/-s/-b/-eの値、複数指定可、読み込み・動き検索は共有）\n");
+	printf("\t--gallop 無音でない間はsetseriフレームおきに１フレームだけ音声を読む（結果は--serialと同じ）\n");
+	printf("\t--silence-only 音声のみ開いて無音区間を出力（SCPosなし）\n\t--fps num/den --silence-only時のフレームレート（省略時はソースの値か30000/1001）\n");
+	printf("\t--audio-threads N 音声の音量最大値を範囲に分けてN個のスレッドで求める（結果は--serialと同じ）\n");
+	printf("\t--coarse breakmuteより長い無音区間で全く同じフレームが続く間は前回の動き検索結果を使う（結果は通常と同じ）\n");
+	printf("\t--picture auto|frame|field 動き検索の単位（autoはインターレースを検出してフレームかフィールドを選ぶ、省略時はfield）\n");
+	printf("\t--roi 黒帯（レターボックス・ピラーボックス）を動き検索の対象から外す\n");
+	printf("\t--avs-threads AviSynth+のPrefetchで先読みするスレッド数\n\t--avs-memory AviSynth環境のメモリ上限（MB）\n");
+	printf("\t--avs-luma AviSynth側で輝度のみに変換\n\t--crop left,top,right,bottom|auto AviSynth側で切り取る範囲（autoは黒帯を検出）\n");
+	printf("\t--checkpoint 途中状態を出力ファイル名.ckptに保存する間隔（秒）\n\t--resume 保存した途中状態から再開\n");
 
 	const char *avsv = NULL;
 	const char *avsa = NULL;
@@ -79,9 +391,30 @@ int main(int argc, const char* argv[])
 	int extendmute = 1;
 	int thin_audio_read = 1;
 	int debug = 0;
-
-	for(int i=1; i<argc-1; i++) {
+	const char *stats = NULL;
+	const char *trace = NULL;
+	double stats_interval = 0;
+	double follow = -1;
+	double checkpoint = -1;
+	int resume = 0;
+	int checkpoint_stop = -1;
+	int shards = 0;
+	const char *index = NULL;
+	int range_start = -1;
+	int range_end = -1;
+	std::vector<const char*> sets;		// --setの設定と出力先の組
+	AvsOption avs;
+	SceneParam sp;
+	int silence_only = 0;
+	int fps_rate = 0, fps_scale = 1;	// --fps（0はソースの値）
+	int audio_threads = 0;
+
+	for(int i=1; i<argc; i++) {
 		const char *s	= argv[i];
+		if (s[0] == '-' && i == argc-1 && is_flag_option(s) == false) {
+			printf("error: no value for %s\n", s);
+			return -1;
+		}
 		if (s[0] == '-') {
 			switch(s[1]) {
 			case 'v':
@@ -125,6 +458,116 @@ int main(int argc, const char* argv[])
 				else if (strcmp(&s[2], "serial") == 0){
 					thin_audio_read = -1;
 				}
+				else if (strcmp(&s[2], "gallop") == 0){
+					thin_audio_read = THIN_GALLOP;
+				}
+				else if (strcmp(&s[2], "stats") == 0){
+					stats = argv[i+1];
+					i++;
+				}
+				else if (strcmp(&s[2], "trace") == 0){
+					trace = argv[i+1];
+					i++;
+				}
+				else if (strcmp(&s[2], "stats-interval") == 0){
+					stats_interval = atof(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "follow") == 0){
+					follow = atof(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "checkpoint") == 0){
+					checkpoint = atof(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "checkpoint-stop") == 0){	// make checkの再開確認用（usageには出さない）
+					checkpoint_stop = atoi(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "resume") == 0){
+					resume = 1;
+				}
+				else if (strcmp(&s[2], "index") == 0){
+					index = argv[i+1];
+					i++;
+				}
+				else if (strcmp(&s[2], "shards") == 0){
+					shards = atoi(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "set") == 0){
+					if (i+2 > argc-1) {
+						printf("error: --set needs params and output path\n");
+						return -1;
+					}
+					sets.push_back(argv[i+1]);
+					sets.push_back(argv[i+2]);
+					i += 2;
+				}
+				else if (strcmp(&s[2], "avs-threads") == 0){
+					avs.threads = atoi(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "avs-memory") == 0){
+					avs.memory_max = atoi(argv[i+1]);
+					i++;
+				}
+				else if (strcmp(&s[2], "silence-only") == 0){
+					silence_only = 1;
+				}
+				else if (strcmp(&s[2], "fps") == 0){
+					int r = 0, sc = 1;
+					if (sscanf(argv[i+1], "%d/%d", &r, &sc) < 1 || r <= 0 || sc <= 0) {
+						printf("error: illegal fps: %s\n", argv[i+1]);
+					} else {
+						fps_rate = r;
+						fps_scale = sc;
+					}
+					i++;
+				}
+				else if (strcmp(&s[2], "audio-threads") == 0){
+					audio_threads = atoi(argv[i+1]);
+					++i;
+				}
+				else if (strcmp(&s[2], "coarse") == 0){
+					sp.coarse = 1;
+				}
+				else if (strcmp(&s[2], "roi") == 0){
+					sp.roi = 1;
+				}
+				else if (strcmp(&s[2], "avs-luma") == 0){
+					avs.luma_only = true;
+				}
+				else if (strcmp(&s[2], "crop") == 0){
+					if (strcmp(argv[i+1], "auto") == 0) {
+						avs.crop_auto = true;
+					} else if (sscanf(argv[i+1], "%d,%d,%d,%d", &avs.crop[0], &avs.crop[1], &avs.crop[2], &avs.crop[3]) != 4) {
+						printf("error: illegal crop: %s\n", argv[i+1]);
+						avs.crop[0] = avs.crop[1] = avs.crop[2] = avs.crop[3] = 0;
+					}
+					i++;
+				}
+				else if (strcmp(&s[2], "picture") == 0){
+					if (strcmp(argv[i+1], "auto") == 0) {
+						sp.picture = PICTURE_AUTO;
+					} else if (strcmp(argv[i+1], "frame") == 0) {
+						sp.picture = FRAME_PICTURE;
+					} else if (strcmp(argv[i+1], "field") == 0) {
+						sp.picture = FIELD_PICTURE;
+					} else {
+						printf("error: illegal picture: %s\n", argv[i+1]);
+					}
+					i++;
+				}
+				else if (strcmp(&s[2], "range") == 0){
+					int r = sscanf(argv[i+1], "%d:%d", &range_start, &range_end);
+					if (r < 1 || range_start < 0 || (r == 2 && range_end <= range_start)) {
+						printf("error: illegal range: %s\n", argv[i+1]);
+						return -1;
+					}
+					i++;
+				}
 				break;
 			default:
 				printf("error: unknown param: %s\n", s);
@@ -145,56 +588,43 @@ int main(int argc, const char* argv[])
 		return -1;
 	}
 
+	if (silence_only) {
+		if (avsa == NULL) {
+			printf("error: no input file!\n");
+			return -1;
+		}
+		ChapterParam param;
+		param.setmute    = setmute;
+		param.setseri    = setseri;
+		param.breakmute  = breakmute;
+		param.extendmute = extendmute;
+		printf("Setting\n");
+		printf("\taudio: %s\n\tout: %s\n", avsa, out);
+		printf("\tmute: %d seri: %d (silence only)\n", setmute, setseri);
+		if (follow >= 0 || shards > 0 || range_start >= 0 || sets.empty() == false || checkpoint >= 0 || checkpoint_stop >= 0 || resume) {
+			printf("warning: --follow/--shards/--range/--set/--checkpoint are ignored with --silence-only\n");
+		}
+		printf("Loading plugins.\n");
+		return silence_main(avsa, out, param, thin_audio_read, fps_rate, fps_scale,
+			stats, trace, stats_interval, debug, avs.memory_max, audio_threads);
+	}
+
 	printf("Setting\n");
 	printf("\tvideo: %s\n\taudio: %s\n\tout: %s\n", avsv, (strcmp(avsv, avsa) ? avsa : "(within video source)"), out);
 	printf("\tmute: %d seri: %d bmute: %d emute: %d\n", setmute, setseri, breakmute, extendmute);
+	for (size_t k=0; k<sets.size(); k+=2) {
+		printf("\tset: %s out: %s\n", sets[k], sets[k+1]);
+	}
 
 	printf("Loading plugins.\n");
 
 	Source *video = NULL;
 	Source *audio = NULL;
 	try {
-		AvsSource *srcv = new AvsSource();
-		srcv->init(avsv);
-		if (srcv->has_video() == false) {
-			srcv->release();
-			throw "Error: No Video Found!";
-		}
-		video = srcv;
+		video = open_video(avsv, avs);
 		// 同じソースの場合は同じインスタンスで読み込む
-		if (strcmp(avsv, avsa) == 0 && srcv->has_audio()) {
-			audio = srcv;
-			audio->add_ref();
-		}
-
-		// 音声が別ファイルの時
-		if (audio == NULL) {
-			if (strlen(avsa) > 4 && _stricmp(".wav", avsa + strlen(avsa) - 4) == 0) {
-				// wav
-				WavSource *wav = new WavSource();
-				wav->init(avsa);
-				if (wav->has_audio()) {
-					audio = wav;
-					audio->set_rate(video->get_input_info().rate, video->get_input_info().scale);
-				} else {
-					wav->release();
-				}
-			} else {
-				// aui
-				AvsSource *aud = new AvsSource();
-				aud->init(avsa);
-				if (aud->has_audio()) {
-					audio = aud;
-					audio->set_rate(video->get_input_info().rate, video->get_input_info().scale);
-				} else {
-					aud->release();
-				}
-			}
-		}
-
-		if (audio == NULL) {
-			throw "Error: No Audio!";
-		}
+		audio = open_audio(avsa, (strcmp(avsv, avsa) == 0) ? video : NULL,
+			video->get_input_info().rate, video->get_input_info().scale, avs.memory_max, video);
 	} catch(const char *s) {
 		if (video) {
 			video->release();
@@ -210,13 +640,78 @@ int main(int argc, const char* argv[])
 		}
 	}
 
+	// --picture autoは開始前に１回だけ判定し、全ての動き検索で同じ単位を使う
+	if (sp.picture == PICTURE_AUTO) {
+		sp.picture = detect_picture(video);
+	}
+
+	ChapterParam param;
+	param.setmute    = setmute;
+	param.setseri    = setseri;
+	param.breakmute  = breakmute;
+	param.extendmute = extendmute;
+
+	SweepRunner sweep;
+	for (size_t k=0; k<sets.size(); k+=2) {
+		ChapterParam p;
+		if (SweepRunner::parse(sets[k], param, &p) == false) {
+			printf("error: illegal set: %s\n", sets[k]);
+			video->release();
+			audio->release();
+			return -1;
+		}
+		sweep.add(p, sets[k+1]);
+	}
+	// --rangeの開始が最後のフレームより後なら部分ファイルが空になる
+	if (range_start >= video->get_input_info().n) {
+		printf("error: illegal range: frame %d is past the end\n", range_start);
+		video->release();
+		audio->release();
+		return -1;
+	}
+
+	// 途中状態の保存・再開（--follow/--shards/--index/--range/--set/--audio-threadsでは使わない）
+	ChapterCheckpoint *ckpt = NULL;
+	ScanState resume_state;
+	int64_t resume_offset = 0;
+	bool resumed = false;
+	if ((checkpoint >= 0 || checkpoint_stop >= 0 || resume) && follow < 0 && shards <= 0 && index == NULL && range_start < 0 && sets.empty()
+		&& audio_threads <= 1) {
+		if (checkpoint < 0) {
+			checkpoint = 30;
+		}
+		ckpt = new ChapterCheckpoint(out,
+			ChapterCheckpoint::make_fingerprint(video, audio, avsv, avsa, param, sp, thin_audio_read, debug), checkpoint);
+		if (resume) {
+			int r = ckpt->load(&resume_state, &resume_offset);
+			if (r < 0) {
+				printf("Error: checkpoint does not match. remove %s.ckpt to start over.\n", out);
+				delete ckpt;
+				video->release();
+				audio->release();
+				return -1;
+			}
+			resumed = (r > 0);
+		}
+	}
+
 	FILE *fout;
-	if (fopen_s(&fout, out, "w") != 0) {
+	if (resumed) {
+		fout = ChapterCheckpoint::open_resume(out, resume_offset);
+	} else if (fopen_s(&fout, out, "w") != 0) {
+		fout = NULL;
+	}
+	if (fout == NULL) {
 		printf("Error: output file open failed.\n");
+		delete ckpt;
 		video->release();
 		audio->release();
 		return -1;
 	}
+	if (ckpt) {
+		ckpt->set_output(fout);
+		ckpt->set_stop(checkpoint_stop);
+	}
 	
 	INPUT_INFO &vii = video->get_input_info();
 	INPUT_INFO &aii = audio->get_input_info();
@@ -237,536 +732,171 @@ int main(int argc, const char* argv[])
 //		//return -1;
 //	}
 
-	short buf[4800*2]; // 10fps以上
 	int n = vii.n;
 
+	if (stats) {
+		g_stats = new ChapterStats(stats);
+		g_stats->video = avsv;
+		g_stats->audio = avsa;
+		g_stats->fps = (double)vii.rate / vii.scale;
+		g_stats->set_frames(n);
+		g_stats->set_interval(stats_interval);
+	}
+	if (trace) {
+		g_trace = new ChapterTrace(trace);
+	}
+
 	// FAW check
-	do {
-		CFAW cfaw;
-		int faws = 0;
-
-		for (int i=0; i<min(90, n); i++) {
-			int naudio = audio->read_audio(i, buf);
-			int j = cfaw.findFAW(buf, naudio);
-			if (j != -1) {
-				cfaw.decodeFAW(buf+j, naudio-j, buf); // test decode
-				faws++;
-			}
-		}
-		if (faws > 5) {
-			if (cfaw.isLoadFailed()) {
-				printf("  Error: FAW detected, but no FAWPreview.auf.\n");
-			} else {
-				printf("  FAW detected.\n");
-				audio = new FAWDecoder(audio);
-			}
+	AudioFrameCache cache;
+	bool faw = check_faw(&audio, n, &cache);
+
+	// --indexは時間分割して全フレームを並列に動き検索
+	if (index) {
+		if (range_start >= 0 || sets.empty() == false || follow >= 0) {
+			printf("warning: --index is ignored with --range/--set/--follow\n");
+			index = NULL;
+		} else if (shards <= 0) {
+			shards = max(1, (int)std::thread::hardware_concurrency());
 		}
-	} while(0);
+	}
+	// --audio-threadsは全フレームを順に検索する時だけ使う
+	if (audio_threads > 1 && (range_start >= 0 || sets.empty() == false || follow >= 0 || shards > 0)) {
+		printf("warning: --audio-threads is ignored with --range/--set/--follow/--shards/--index\n");
+		audio_threads = 0;
+	}
 
-	if (thin_audio_read <= 0){
+	if (range_start >= 0){
+		if (range_end < 0 || range_end > n) {
+			range_end = n;
+		}
+		printf("read audio : range %d - %d\n", range_start, range_end);
+	}
+	else if (sets.empty() == false){
+		printf("read audio : %d sets\n", (int)sets.size() / 2 + 1);
+	}
+	else if (follow >= 0){
+		printf("read audio : follow (timeout %.1fs)\n", follow);
+	}
+	else if (shards > 0){
+		printf("read audio : %d shards%s\n", shards, index ? " (index)" : "");
+	}
+	else if (audio_threads > 1){
+		printf("read audio : %d threads\n", audio_threads);
+	}
+	else if (thin_audio_read <= 0){
 		printf("read audio : serial\n");
 	}
+	else if (thin_audio_read == THIN_GALLOP){
+		printf("read audio : gallop\n");
+	}
 	printf("--------\nStart searching...\n");
 
-	short mute = setmute;
-	int seri = 0;
-	int idx = 1;
-	int volume;
-	int lastmute_scpos = -1;			// -eオプションの検索オーバーラップを考慮して前回位置保持
-	int lastmute_marker = -1;			// マーク表示用の起点位置保持
-	int w = vii.format->biWidth & 0xFFFFFFF0;
-	int h = vii.format->biHeight & 0xFFFFFFF0;
-	unsigned char *pix0 = (unsigned char*)_aligned_malloc(w * h, 32);
-	unsigned char *pix1 = (unsigned char*)_aligned_malloc(w * h, 32);
-
-	// start searching
-	for (int i=0; i<n-setseri-1; i++) {
-		// searching foward frame
-		if (seri == 0 && thin_audio_read > 0) {		// 間引きしながら無音確認
-			int naudio = audio->read_audio(i+setseri-1, buf);
-
-			bool skip = false;
-			for (int j=0; j<naudio; ++j) {
-				volume = abs(buf[j]);
-				//if (abs(buf[j]) > mute) {
-				if (volume > mute) {
-					skip = true;
-					break;
-				}
-			}
-			if (skip) {
-				i += setseri;
-			}
-		}
-
-		bool nomute = false;
-		int naudio = audio->read_audio(i, buf);
-
-		for (int j=0; j<naudio; ++j) {
-			volume = abs(buf[j]);
-			//if (abs(buf[j]) > mute) {
-			if (volume > mute) {
-				nomute = true;
-				break;
-			}
-		}
-
-		//
-		if (nomute || i == n-1) {
-			// owata
-			if (seri >= setseri) {
-				int start_fr = i - seri;
-
-				fprintf(stderr,"mute%2d: %d - %dフレーム\n", idx, start_fr, seri);
-
-				//--- 区間内のシーンチェンジを取得 ---
-				proc_scene_change(video, &lastmute_scpos, &lastmute_marker, fout, pix0, pix1, w, h,
-									start_fr, seri, setseri, breakmute, extendmute, debug, idx);
-
-
-				idx++;
-			}
-			seri = 0;
-		} else {
-			seri++;
-		}
+	if (resumed) {
+		printf("resume from frame %d\n", resume_state.i);
 	}
-	fprintf(stderr,"end\n");
-	_aligned_free(pix0);
-	_aligned_free(pix1);
-	// 最終フレーム番号を出力（改造版で追加）
-	fprintf(fout, "# SCPos:%d %d\n", n-1, n-1);
-
-	// ソースを解放
-	video->release();
-	audio->release();
-
-	return 0;
-}
 
-
-// 区間内のシーンチェンジを取得・出力
-int proc_scene_change(
-	Source *video,					// 画像クラス
-	int *lastmute_scpos,			// -eオプションの検索オーバーラップを考慮して前回位置保持（上書き更新）
-	int *lastmute_marker,			// マーク表示用の起点位置保持（上書き更新）
-	FILE *fout,						// 出力ファイル
-	unsigned char *pix0,			// 画像データ保持バッファ（１枚目）
-	unsigned char *pix1,			// 画像データ保持バッファ（２枚目）
-	int w,							// 画像幅
-	int h,							// 画像高さ
-	int start_fr,					// 開始フレーム番号
-	int seri,						// 無音区間フレーム数
-	int setseri,					// 最低無音フレーム数
-	int breakmute,					// 無音シーン検索間隔フレーム数
-	int extendmute,					// 無音前後検索拡張フレーム数
-	int debug,						// デバッグ情報表示する時は1
-	int idx							// 無音区間通算番号
-){
-	const int space_sc1  = 5;		// シーンチェンジ間の最低フレーム間隔
-	const int space_sc2 = 10;		// シーンチェンジ間の最低フレーム間隔（位置上書きになる場合用１）
-	const int space_sc3 = 30;		// シーンチェンジ間の最低フレーム間隔（位置上書きになる場合用２）
-	const int THRES_RATE1 = 300;	// 明確なシーンチェンジ判定用の閾値
-	const int THRES_RATE2 = 7;		// 変化なし判定用の閾値
-	INPUT_INFO &vii = video->get_input_info();
-	int n = vii.n;					// フレーム数
-	int ncount_sc = 0;				// シーンチェンジ数カウント
-
-	//--- シーンチェンジ情報初期化 ---
-	int msel = 0;					// 何番目のシーンチェンジか（0-）
-	int d_max_en[DEF_SCMAX];		// シーンチェンジの有効性
-	int d_max_flagsc[DEF_SCMAX];	// シーンチェンジ判定フラグ
-	int d_max_pos[DEF_SCMAX];		// シーンチェンジ地点フレーム番号
-	int d_max_mvec[DEF_SCMAX];		// シーンチェンジ地点動き情報
-	int d_maxp_mvec[DEF_SCMAX];		// シーンチェンジ１フレーム前動き情報
-	int d_maxn_mvec[DEF_SCMAX];		// シーンチェンジ１フレーム後動き情報
-	int d_max_mvec2[DEF_SCMAX];		// シーンチェンジ地点インターレース用動き情報
-	int d_maxp_mvec2[DEF_SCMAX];	// シーンチェンジ１フレーム前インターレース用動き情報
-	int d_maxn_mvec2[DEF_SCMAX];	// シーンチェンジ１フレーム後インターレース用動き情報
-	int d_max_scrate[DEF_SCMAX];	// シーンチェンジ地点のシーンチェンジ判定値（0-100）
-
-	for(int k=0; k<DEF_SCMAX; k++){
-		d_max_en[k]     = 0;
-		d_max_flagsc[k] = 0;
-	}
-
-	//--- 個別シーンチェンジ位置情報取得 ---
+	// start searching
+	bool failed = false;
 	{
-		//--- 位置情報設定 ---
-		int range_start_fr = start_fr - extendmute - 1;			// 計算開始フレーム
-		int valid_start_fr = start_fr - extendmute;				// 検索開始フレーム
-		int range_end_fr   = start_fr + seri + extendmute + 1;	// 計算終了フレーム
-		int valid_end_fr   = start_fr + seri + extendmute;		// 検索終了フレーム
-		if (range_start_fr < 0){
-			range_start_fr = 0;
-		}
-		if (valid_start_fr < 0){
-			valid_start_fr = 0;
-		}
-		if (range_end_fr >= n){
-			range_end_fr = n-1;
-		}
-		if (valid_end_fr >= n){
-			valid_end_fr = n-1;
-		}
-
-		//--- 前回位置情報取得 ---
-		int last_fr = range_start_fr - 1;
-		if (last_fr < 0){
-			last_fr = 0;
-		}
-		video->read_video_y8(last_fr, pix0);
-
-		//--- ローカル変数 ---
-		int local_end_fr;				// シーンチェンジ確定フレーム位置
-		int local_cntsc;				// 指定期間内シーンチェンジ回数
-		int pos_lastchange;				// 前回変化位置
-		int skip_update;				// 連続フレームシーンチェンジ無視用
-		int cmvec;						// インターレースの動き多い側取得用
-		int cmvec2;						// インターレースの動き少ない側取得用
-		int rate_sc;					// シーンチェンジ判定値（flag_scの元となる値）
-		int flag_sc;					// シーンチェンジ判定フラグ
-		int flag_sc_hold = 0;			// 保持シーンチェンジ判定フラグ
-		int last_cmvec  = 0;			// 前フレームの動き情報記憶用
-		int last_cmvec2 = 0;			// 前フレームのインターレース用動き情報記憶用
-		int last_rate = 0;				// 直前のシーンチェンジ判定領域値
-		int keep_schk = 0;				// 直前シーンチェンジの保持観察フラグ
-		int keep_msel = 0;				// 直前シーンチェンジの保持位置
-
-		//--- 検索開始前設定 ---
-		local_cntsc = 0;						// 指定期間内シーンチェンジ回数
-		local_end_fr = start_fr + breakmute;	// 次のシーンチェンジ確定フレーム指定
-		pos_lastchange = -space_sc1;			// 前回変化位置
-		if (*lastmute_scpos > 0){				// 前回シーンチェンジが存在する場合
-			pos_lastchange = *lastmute_scpos;	// シーンチェンジ直後は間隔をあけるため
+		SourceMuteReader mreader(audio, setmute);
+		if (faw == false) {
+			mreader.set_cache(&cache);
 		}
-
-		//--- 各フレーム画像データからシーンチェンジ情報を取得 ---
-		for (int x=range_start_fr; x<=range_end_fr; x++) {
-			//--- データ取得 ---
-			video->read_video_y8(x, pix1);
-			rate_sc = mvec( &cmvec, &cmvec2, &flag_sc, pix1, pix0, w, h, (100-0)*(100/FIELD_PICTURE), FIELD_PICTURE, x);
-			if (d_max_en[msel] > 0){
-				if (x == d_max_pos[msel]+1){			// シーンチェンジ１フレーム後の動き情報更新
-					d_maxn_mvec[msel]  = cmvec;
-					d_maxn_mvec2[msel] = cmvec2;
-				}
-			}
-			//--- シーンチェンジ格納処理 ---
-			if (msel < DEF_SCMAX-1){							// 配列が埋まっていないこと前提
-				if (flag_sc_hold > 0){							// シーンチェンジ検出切り替え地点
-					if (local_cntsc < 1){						// 現地点を残してさらに候補追加可能な時
-						local_cntsc ++;
-						msel ++;
-						flag_sc_hold = 0;
-					}
-				}
-				if (x >= local_end_fr){			// 指定期間無音が続いた場合
-					if (local_cntsc == 0 && d_max_en[msel] > 0){	// シーンチェンジがなかったら確定
-						msel ++;
-					}
-					else if (flag_sc_hold > 0){		// シーンチェンジ確定
-						msel ++;
-					}
-					else{
-						d_max_en[msel] = 0;
-					}
-					local_end_fr += breakmute;	// 次のシーンチェンジ確定フレーム指定
-					local_cntsc = 0;			// 指定期間内シーンチェンジ回数
-					flag_sc_hold = 0;
+		SourceSceneReader sreader(video, sp);
+		// 黒帯は最初に検出した結果を全インスタンスで使う
+		sreader.get_roi(&sp);
+		ChapterFileWriter writer(fout, vii.rate, vii.scale, debug);
+		// 並列処理のスレッドで起きた例外もここで受け取る
+		try {
+			if (range_start >= 0) {
+				// 部分ファイルを出力（最終行はmerge時に出力）
+				PartialResult pr;
+				pr.fingerprint = ChapterCheckpoint::make_fingerprint(video, audio, "", "", param, sp, 0, debug);
+				pr.n = n;
+				pr.rate = vii.rate;
+				pr.scale = vii.scale;
+				pr.debug = debug;
+				pr.param = param;
+				pr.sp = sp;
+				pr.start = range_start;
+				pr.end = range_end;
+				pr.analyze(video, audio);
+				pr.write(fout);
+			} else if (sets.empty() == false) {
+				if (sweep.run(video, audio, &writer, param, sp, n, vii.rate, vii.scale, debug) != 0) {
+					failed = true;
 				}
-			}
-			//--- シーンチェンジ判定処理 ---
-			if (x < valid_start_fr || x > valid_end_fr){		// 検索範囲外
-			}
-			else{
-				//--- シーンチェンジ上書きになる場合の実行を判別 ---
-				if (flag_sc > 0 && d_max_flagsc[msel] > 0){			// シーンチェンジありで上書きになる場合
-//					printf("overwrite %d,%d,%d -> %d,%d,%d\n", d_max_pos[msel], d_max_mvec[msel], d_max_scrate[msel], x, cmvec, rate_sc);
-					if (abs(x - d_max_pos[msel]) <= space_sc2){ 	// 上書き前の位置から間隔が短い場合
-						if (d_max_scrate[msel] >= THRES_RATE1 ||	// 前回地点の画面転換割合が大きい場合無効化
-							rate_sc < THRES_RATE1 ||				// 今回地点の画面転換割合が小さい場合無効化
-							last_rate * 2 > rate_sc){				// 前画面から変化が大きくない場合無効化
-							flag_sc = 0;
-						}
-					}
-					if (abs(x - d_max_pos[msel]) <= space_sc3){		// 上書き前の位置から間隔が指定内の場合
-						if (d_max_scrate[msel] > rate_sc ||			// 前回より画面転換割合が小さい場合無効化
-							last_rate * 2 > rate_sc){				// 前画面から変化が大きくない場合無効化
-							flag_sc = 0;
-						}
-					}
+			} else if (follow >= 0) {
+				n = follow_chapter(video, audio, &mreader, &sreader, &writer, param, follow);
+			} else if (shards > 0) {
+				AvsOption opt = avs;
+				if (opt.memory_max <= 0 && shards > 1) {
+					opt.memory_max = POOL_MEMORY_MB;
 				}
-//if (x > 50108 && x < 50118){
-//printf("(%d %d %d %d %d)\n", x, flag_sc, rate_sc, last_rate, pos_lastchange);
-//}
-				//--- シーンチェンジ直後の再シーンチェンジ実行を判別 ---
-				// 原則シーンチェンジ検出直後は連続で保持しないよう間隔をあける
-				skip_update = 0;
-				if (abs(x - pos_lastchange) <= space_sc1 &&
-					x - pos_lastchange != 0){					// 前回シーンチェンジ付近のフレームは
-					skip_update = 1;							// 連続で保持しない（標準設定）
-					if (keep_schk > 0){							// 差し替え可能性から観察必要時
-						if (flag_sc > 0 &&						// 今回もシーンチェンジ
-							rate_sc >= THRES_RATE1 &&			// 画面転換割合が大きい
-							d_max_scrate[keep_msel] * 2 <= rate_sc &&	// 前回地点よりはるかに変化大
-							last_rate * 3 <= rate_sc){			// 前画面よりはるかに変化大
-							// 上記条件時は例外としてシーンチェンジ設定を行う（上書き設定）
-							skip_update = 0;
-							if (msel != keep_msel){				// 設定位置が変わっていたら戻す
-								msel = keep_msel;
-								if (local_cntsc > 0){			// カウントも増えていたら戻す
-									local_cntsc --;
-								}
-							}
-						}
-					}
+				// 黒帯は最初に開いた時の検出結果を全インスタンスで使う
+				AvsSource *avsv_src = dynamic_cast<AvsSource*>(video);
+				if (avsv_src) {
+					avsv_src->get_crop(&opt);
 				}
-				else{											// シーンチェンジから離れたら
-					keep_schk = 0;								// 観察終了
-				}
-				//--- シーンチェンジ更新処理 ---
-				if (skip_update == 0){
-					int flag_rateup = 0;
-					if ((d_max_scrate[msel] < rate_sc && rate_sc >= THRES_RATE2) ||
-						(d_max_scrate[msel] == rate_sc && d_max_mvec[msel] < cmvec) ||
-						(d_max_scrate[msel] < THRES_RATE2 &&
-						 rate_sc < THRES_RATE2 && d_max_mvec[msel] < cmvec)){
-						flag_rateup = 1;
-					}
-					if ((d_max_flagsc[msel] == 0 && flag_rateup > 0)||
-							  d_max_en[msel] == 0 || flag_sc > 0) {		// シーンチェンジ地点更新
-						d_max_en[msel]     = 1;
-						d_max_pos[msel]    = x;
-						d_max_mvec[msel]   = cmvec;
-						d_maxp_mvec[msel]  = last_cmvec;
-						d_maxn_mvec[msel]  = 0;
-						d_max_mvec2[msel]  = cmvec2;
-						d_maxp_mvec2[msel] = last_cmvec2;
-						d_maxn_mvec2[msel] = 0;
-						d_max_scrate[msel] = rate_sc;
-						if (flag_sc > 0){			// シーンチェンジあり
-							flag_sc_hold = 1;
-							d_max_flagsc[msel] = 1;
-							pos_lastchange = x;						// シーンチェンジ直後は間隔をあけるため位置保持
-							if (rate_sc < THRES_RATE1){				// 画面転換量が少ない時は数フレーム要観察
-								keep_schk = 1;
-								keep_msel = msel;
-							}
-						}
+				InputFactory factory(avsv, avsa, vii.rate, vii.scale, faw, opt);
+				SourcePool pool(&factory, shards);
+				ShardRunner runner(&pool, param, sp, n, shards);
+				runner.set_all(index != NULL);
+				runner.run(&writer);
+				if (index) {
+					if (write_scene_index(index, runner.scene(), n, vii.rate, vii.scale,
+						vii.format->biWidth & 0xFFFFFFF0, vii.format->biHeight & 0xFFFFFFF0, sp) == false) {
+						printf("Error: index file write failed. (%s)\n", index);
+						failed = true;
 					}
 				}
+			} else if (audio_threads > 1) {
+				search_peak_chapter(avsa, vii.rate, vii.scale, faw, avs.memory_max, audio_threads,
+					&sreader, &writer, param, n);
+			} else {
+				search_chapter(&mreader, &sreader, &writer, param, n, thin_audio_read,
+					resumed ? &resume_state : NULL, ckpt);
 			}
-			//--- 次のフレーム準備 ---
-			unsigned char *tmp = pix0;
-			pix0 = pix1;
-			pix1 = tmp;
-			last_cmvec  = cmvec;
-			last_cmvec2 = cmvec2;
-			last_rate = rate_sc;
-//if (x>=48889 && x<=48910) printf("[%d:%d,%d,%d,%d]", x,cmvec,rate_sc,d_max_mvec[msel],d_max_flagsc[msel]);
-//					if (x>=9265 && x<=9269){
-//						fprintf(fout, "(%d:%d)",x,cmvec);
-//					}
+		} catch (const char *s) {
+			printf("%s\n", s);
+			failed = true;
+		} catch (const AvisynthError &err) {
+			printf("Avisynth ERROR: %s\n", err.msg);
+			failed = true;
 		}
-
-		// ２箇所目以降でシーンチェンジがなかったら無効化
-		if (flag_sc_hold == 0 && msel > 0){
-			if (local_cntsc > 0 || (local_end_fr - breakmute + setseri > range_end_fr)){
-				d_max_en[msel] = 0;
-			}
+		fprintf(stderr,"end\n");
+		if (range_start < 0 && failed == false) {
+			writer.write_end(n);
 		}
 	}
-
-	//--- シーンチェンジ情報加工 ---
-	int d_maxpre_pos[DEF_SCMAX];		// シーンチェンジ前の位置
-	int d_maxrev_pos[DEF_SCMAX];		// シーンチェンジ後の位置
-	int msel_max = 0;					// 最大のシーンチェンジ選択
-	{
-		// add for searching last frame before changing scene
-		// シーンチェンジ前後のフレーム番号を取得（インターレース片側変化中を外す）
-		for(int k=0; k<=msel; k++){
-			if (d_max_en[k] > 0){
-				d_maxpre_pos[k] = d_max_pos[k] - 1;		// 通常は１フレーム前がシーンチェンジ前
-				if (d_max_mvec[k] < d_maxp_mvec[k] * 2 && d_maxp_mvec[k] > d_maxp_mvec2[k] * 2 &&
-					d_max_mvec[k] - d_max_mvec2[k] > d_max_mvec[k] / 16){
-					d_maxpre_pos[k] = d_max_pos[k] - 2;
-				}
-				d_maxrev_pos[k] = d_max_pos[k];			// 通常はシーンチェンジ地点がシーンチェンジ後
-				if (d_maxrev_pos[k] - d_maxpre_pos[k] < 2){
-					if (d_max_mvec[k] > d_max_mvec2[k] * 2 &&
-						d_max_mvec[k] < d_maxn_mvec[k] * 2 &&
-						d_maxn_mvec[k] - d_maxn_mvec2[k] > d_maxn_mvec[k] / 16 &&
-						(d_maxn_mvec[k] > d_maxn_mvec2[k] * 2 || d_max_mvec[k] < d_maxn_mvec2[k] * 2)){
-						d_maxrev_pos[k] = d_max_pos[k] + 1;
-					}
-				}
-				if (d_maxpre_pos[k] < 0){
-					d_maxpre_pos[k] = 0;
-				}
-				if (d_maxrev_pos[k] < 0){
-					d_maxrev_pos[k] = 0;
-				}
-			}
-		}
-		// 複数候補があり、かつ変化のないシーンチェンジがある場合は削除
-		if (msel >= 1){
-			// 最大変化位置確認（max_msel値も更新）
-			int d_tmpmax      = -1;
-			int rate_tmpmax   = -1;
-			for(int k=0; k<=msel; k++){
-				if (d_max_en[k] > 0){
-					if ((d_max_scrate[k] > rate_tmpmax) ||
-						(d_max_scrate[k] == rate_tmpmax && d_max_mvec[k] > d_tmpmax)){
-						msel_max = k;
-						rate_tmpmax = d_max_scrate[k];
-						d_tmpmax    = d_max_mvec[k];
-					}
-				}
-			}
-			// 最大変化位置を除き、変化のない候補は削除
-			for(int k=0; k<=msel; k++){
-				if (d_max_en[k] > 0){
-					if (d_max_scrate[k] < THRES_RATE2 && k != msel_max){
-						d_max_en[k] = 0;
-					}
-				}
-			}
-		}
-
-		// 最後のシーンチェンジ位置を記憶（次の無音区間のオーバーラップ検出用）
-		int tmp_scpos = -1;
-		int tmp_flagsc = 0;
-		for(int k=0; k<=msel; k++){
-			if (d_max_en[k] > 0){
-				if (tmp_scpos < d_max_pos[k]){
-					tmp_scpos  = d_max_pos[k];
-					tmp_flagsc = d_max_flagsc[k];
-				}
-			}
-		}
-		if (tmp_flagsc > 0){			// 最後が明確なシーンチェンジだった時のみ設定
-			*lastmute_scpos = tmp_scpos;
-		}
-		else{
-			*lastmute_scpos = -1;
-		}
+	fclose(fout);
+	if (failed) {
+		delete ckpt;
+		video->release();
+		audio->release();
+		return -1;
+	}
+	if (ckpt) {
+		// 最後まで出力できたので途中状態は不要
+		ckpt->remove_file();
+		delete ckpt;
 	}
 
-	//--- シーンチェンジ情報表示用 ---
-	{
-		// 長時間無音シーンチェンジ設定幅があるか確認
-		int flag_force_sc = 0;			// 指定期間内で強制的にシーンチェンジを行ったか
-		if (msel > 0){		// ２つ以上の間隔
-			int msel_s = -1;			// 最初の有効番号
-			int msel_e = -1;			// 最後の有効番号
-			for(int k=0; k<=msel; k++){
-				if (d_max_en[k] > 0){
-					msel_e = k;
-					if (msel_s < 0){
-						msel_s = k;
-					}
-				}
-			}
-			if (d_max_pos[msel_e] - d_max_pos[msel_s] > breakmute){
-				flag_force_sc = 1;
-			}
-		}
-
-		// マーク内容と位置を決める
-		int msel_mark = msel_max;
-		int msel_mknext  = msel_max;
-		int mark_type = 0;
-		int difmin = 30;
-		int last_frame;
-		if (*lastmute_marker < 0){					// 最初の無音の前回は無効
-			last_frame = -10000;
-		}
-		else{
-			last_frame = *lastmute_marker;
-		}
-		for(int k=0; k<=msel; k++){
-			if (d_max_en[k] == 0) continue;		// シーンチェンジ候補から外れた場合次に
-			int dif = abs(d_max_pos[k] - last_frame - 30*15);
-			if (dif < difmin){
-				difmin = dif;
-				msel_mark = k;
-				mark_type = 15;				// 15秒間隔
-			}
-			dif = abs(d_max_pos[k] - last_frame - 30*30);
-			if (dif < difmin){
-				difmin = dif;
-				msel_mark = k;
-				mark_type = 30;				// 30秒間隔
-			}
-			dif = abs(d_max_pos[k] - last_frame - 30*45);
-			if (dif < difmin){
-				difmin = dif;
-				msel_mark = k;
-				mark_type = 45;				// 45秒間隔
-			}
-			dif = abs(d_max_pos[k] - last_frame - 30*60);
-			if (dif < difmin){
-				difmin = dif;
-				msel_mark = k;
-				mark_type = 60;				// 60秒間隔
-			}
-			if (k == msel_mark){			// マーク位置更新時
-				msel_mknext = k;			// 次マーク起点も同様に更新
-			}
-			if (seri > breakmute){			// 無音期間が長い場合
-				if (k > msel_mark){			// マークから離れている場合
-					if (abs(d_max_pos[k] - d_max_pos[msel_mark]) > breakmute){
-						msel_mknext = k;	// 次マーク起点は最後の位置
-					}
-				}
-			}
-		}
-
-		//--- 結果表示 ---
-		for(int k=0; k<=msel; k++){
-			const char *mark = "";
-			if (d_max_en[k] == 0) continue;		// シーンチェンジ候補から外れた場合次に
+	if (g_stats) {
+		g_stats->write(true, n);
+		delete g_stats;
+		g_stats = NULL;
+	}
+	if (g_trace) {
+		g_trace->write();
+		delete g_trace;
+		g_trace = NULL;
+	}
 
-			if (d_max_scrate[k] < THRES_RATE2){	// 全く変化のないシーンチェンジ
-				mark = "＿";
-			}
-			else if ((flag_force_sc > 0 && (k != msel_mark || mark_type == 0)) ||	// 指定無音区間内シーンチェンジ地点
-					  (d_max_scrate[k] < THRES_RATE2 && k != msel_max)){			// 動きなしで残っている場合
-				mark = "○";
-			}
-			else if (k == msel_mark){
-				if (idx > 1 && mark_type == 15) {
-					mark = "★";
-				} else if (idx > 1 && mark_type == 30) {
-					mark = "★★";
-				} else if (idx > 1 && mark_type == 45) {
-					mark = "★★★";
-				} else if (idx > 1 && mark_type == 60) {
-					mark = "★★★★";
-				}
-			}
-			else{	// 無音区間内で第2候補シーンチェンジ
-					mark = "＠";
-			}
-			printf("\t SCPos: %d %s\n", d_max_pos[k], mark);
-			ncount_sc ++;
+	// ソースを解放
+	video->release();
+	audio->release();
 
-			char title[256];
-			sprintf_s(title, "%dフレーム %s SCPos:%d %d", seri, mark, d_maxrev_pos[k], d_maxpre_pos[k]);
-			if (debug == 0){		// normal
-				write_chapter(fout, idx, start_fr, title, &vii);
-			}
-			else{					// for debug
-				char tmp_title[256];
-				sprintf_s(tmp_title, " Rate:%d", d_max_scrate[k]);
-				strcat(title, tmp_title);
-//				sprintf_s(tmp_title, " : [%d %d] [%d %d] [%d %d]"), d_maxn_mvec[k], d_maxn_mvec2[k], d_max_mvec[k], d_max_mvec2[k], d_maxp_mvec[k], d_maxp_mvec2[k]);
-//				strcat(title, tmp_title);
-				write_chapter_debug(fout, idx, start_fr, title, &vii);
-			}
-		}
-		*lastmute_marker = d_max_pos[msel_mknext];
-	}
-	return ncount_sc;			// 検出した位置の合計を返す
+	return 0;
 }
+
@@ -0,0 +1,109 @@
+// libchapterexeのC APIの確認（make checkで実行）
+// 合成ソースのフレームをchapterexe_push_frame()で１枚ずつ渡し、通知された結果を
+// chapter_exeと同じ形式で出力する（check/goldenと比較）。
+//   usage: check_capi [-m N] [-s N] [-b N] [-e N] [--debug] -v synth://シナリオ名 -o 出力
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "libchapterexe.h"
+#include "chapter.h"
+#include "synthetic.h"
+
+static void on_mute(void *user, const chapterexe_mute *m) {
+	((ChapterFileWriter*)user)->write_mute(m->idx, m->start_frame, m->frames);
+}
+
+static void on_scpos(void *user, const chapterexe_scpos *s) {
+	ScenePos sp;
+	sp.idx = s->idx;
+	sp.start_fr = s->start_frame;
+	sp.seri = s->frames;
+	sp.pos = s->pos;
+	sp.rev_pos = s->rev_pos;
+	sp.pre_pos = s->pre_pos;
+	sp.rate = s->rate;
+	sp.mark = s->mark;
+	((ChapterFileWriter*)user)->write_scpos(sp);
+}
+
+int main(int argc, const char *argv[]) {
+	chapterexe_param param;
+	chapterexe_param_default(&param);
+	const char *in = NULL;
+	const char *out = NULL;
+	int debug = 0;
+	for (int i=1; i<argc; i++) {
+		const char *s = argv[i];
+		if (strcmp(s, "--debug") == 0) {
+			debug = 1;
+		} else if (i + 1 < argc && strcmp(s, "-m") == 0) {
+			param.setmute = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(s, "-s") == 0) {
+			param.setseri = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(s, "-b") == 0) {
+			param.breakmute = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(s, "-e") == 0) {
+			param.extendmute = atoi(argv[++i]);
+		} else if (i + 1 < argc && strcmp(s, "-v") == 0) {
+			in = argv[++i];
+		} else if (i + 1 < argc && strcmp(s, "-o") == 0) {
+			out = argv[++i];
+		} else {
+			printf("error: unknown param: %s\n", s);
+			return -1;
+		}
+	}
+	if (in == NULL || out == NULL) {
+		printf("usage: check_capi [-m N] [-s N] [-b N] [-e N] [--debug] -v synth://name -o out\n");
+		return -1;
+	}
+
+	SyntheticSource *src = new SyntheticSource();
+	try {
+		src->init(in);
+	} catch (const char *s) {
+		printf("%s\n", s);
+		src->release();
+		return -1;
+	}
+	INPUT_INFO &ii = src->get_input_info();
+	int w = ii.format->biWidth & 0xFFFFFFF0;
+	int h = ii.format->biHeight & 0xFFFFFFF0;
+
+	FILE *f = fopen(out, "w");
+	if (f == NULL) {
+		printf("Error: output file open failed.\n");
+		src->release();
+		return -1;
+	}
+	ChapterFileWriter writer(f, ii.rate, ii.scale, debug);
+	chapterexe *ce = chapterexe_create(&param, w, h, on_mute, on_scpos, &writer);
+	if (ce == NULL) {
+		printf("Error: chapterexe_create failed.\n");
+		fclose(f);
+		src->release();
+		return -1;
+	}
+
+	int ret = 0;
+	std::vector<unsigned char> luma(w * h);
+	std::vector<short> pcm(AUDIO_BUF_SIZE);
+	for (int i=0; i<ii.n && ret == 0; i++) {
+		src->read_video_y8(i, &luma[0]);
+		int naudio = src->read_audio(i, &pcm[0]);
+		ret = chapterexe_push_frame(ce, &luma[0], w, &pcm[0], naudio);
+	}
+	if (ret == 0) {
+		ret = chapterexe_finish(ce);
+	}
+	if (ret == 0) {
+		writer.write_end(ii.n);
+	} else {
+		printf("Error: chapterexe API failed.\n");
+	}
+	chapterexe_destroy(ce);
+	fclose(f);
+	src->release();
+	return ret;
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# libchapterexeのC APIの出力確認
+#   usage: run_capi.sh check_capi
+#   check_capiで合成ソースをchapterexe_push_frame()に渡した結果をcheck/golden/と比較する。
+
+EXE=${1:-./check_capi}
+DIR=$(dirname "$0")
+GOLDEN=$DIR/golden
+WORK=check.out
+
+# goldenの名前 と check_capiへの引数（chapter_exeと同じ設定）
+SCENARIOS="
+basic         -v synth://basic
+basic_serial  -v synth://basic -s 10
+cm            -v synth://cm
+cm_hd         -v synth://cm@1440x1080
+fade          -v synth://fade
+blank         -v synth://blank -e 3
+interlace     -v synth://interlace
+long          -v synth://long
+long_debug    --debug -v synth://long -b 30
+"
+
+mkdir -p "$WORK"
+failed=$(echo "$SCENARIOS" | while read -r name args; do
+	[ -z "$name" ] && continue
+	out=$WORK/capi_$name.txt
+	# shellcheck disable=SC2086
+	if "$EXE" $args -o "$out" > "$WORK/capi_$name.log" 2>&1 && cmp -s "$out" "$GOLDEN/$name.txt"; then
+		printf 'capi %-14s ok\n' "$name" >&2
+	else
+		printf 'capi %-14s NG\n' "$name" >&2
+		diff "$GOLDEN/$name.txt" "$out" >&2
+		printf '%s ' "$name"
+	fi
+done)
+
+if [ -n "$failed" ]; then
+	echo "capi check failed: $failed"
+	exit 1
+fi
+echo "capi check passed."
+exit 0
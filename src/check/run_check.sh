@@ -0,0 +1,141 @@
+#!/bin/sh
+# 合成ソース（synth://）を使った出力確認と処理速度の記録
+#   usage: run_check.sh chapter_exe [--update]
+#   出力をcheck/golden/の結果と比較し、シナリオごとのfpsをcheck.jsonに記録する。
+#   --update 指定時は比較せずにgoldenを更新する。
+
+EXE=${1:-./chapter_exe}
+UPDATE=$2
+DIR=$(dirname "$0")
+GOLDEN=$DIR/golden
+WORK=check.out
+RESULT=check.json
+
+# 名前 と chapter_exeへの引数
+SCENARIOS="
+basic         -v synth://basic
+basic_serial  -v synth://basic --serial -s 10
+cm            -v synth://cm
+cm_hd         -v synth://cm@1440x1080
+fade          -v synth://fade
+blank         -v synth://blank -e 3
+interlace     -v synth://interlace
+long          -v synth://long
+long_debug    --debug -v synth://long -b 30
+long_follow   --follow 0 -v synth://long?grow=150
+cm_gallop     --gallop -v synth://cm
+cm_silence    --silence-only -v synth://cm
+cm_set        --set 30,8,,2 check.out/cm_set2.txt -v synth://cm
+long_roi      --roi --debug -b 30 -v synth://long@1440x1080?pillar=180
+long_index    --index check.out/long.idx --shards 2 -v synth://long
+long_coarse   --coarse -v synth://long
+cm_athreads   --audio-threads 3 -v synth://cm
+fade_frame    --picture auto -v synth://fade
+ilace_field   --picture auto -v synth://interlace?field=2
+still_pict    --picture auto --range 0: -v synth://still
+basic_s24     -m 20 -v synth://basic?audio=s24
+basic_s32     -m 20 -v synth://basic?audio=s32
+basic_float   -m 20 -v synth://basic?audio=float
+long_range    @range 310,450 -v synth://long
+cm_resume     @resume 2000 -v synth://cm
+cm_set_fail   @fail --set 30,8,,2 check.out/none/cm_set2.txt -v synth://cm
+long_idx_fail @fail --index check.out/none/long.idx --shards 2 -v synth://long
+range_rev     @fail --range 450:310 -v synth://long
+range_past    @fail --range 820: -v synth://long
+"
+
+# @range 分割位置,... 引数 : 無音の途中で--rangeに分けて解析し、mergeで結合した結果を確認
+run_range() {
+	r_out=$1
+	r_splits=$2
+	shift 2
+	r_parts=""
+	r_start=0
+	for r_end in $(echo "$r_splits" | tr ',' ' ') ""; do
+		"$EXE" "$@" --range "$r_start:$r_end" -o "$r_out.$r_start" || return 1
+		r_parts="$r_parts $r_out.$r_start"
+		r_start=$r_end
+	done
+	# shellcheck disable=SC2086
+	"$EXE" merge -o "$r_out" $r_parts
+}
+
+# @fail 引数 : エラーで終了することを確認（出力は比較しない）
+run_fail() {
+	r_out=$1
+	shift
+	"$EXE" "$@" -o "$r_out" && return 1
+	return 0
+}
+
+# @resume 中断フレーム 引数 : 中断フレームで止めた途中状態から--resumeで再開した結果を確認
+# （設定の違う再開が拒否されることも確認）
+run_resume() {
+	r_out=$1
+	r_stop=$2
+	shift 2
+	rm -f "$r_out" "$r_out.ckpt"
+	"$EXE" "$@" --checkpoint-stop "$r_stop" -o "$r_out"
+	[ $? -eq 3 ] && [ -f "$r_out.ckpt" ] || return 1
+	"$EXE" "$@" -m 40 --resume -o "$r_out" && return 1
+	"$EXE" "$@" --resume -o "$r_out" | grep "resume from frame" || return 1
+	[ ! -f "$r_out.ckpt" ]
+}
+
+mkdir -p "$WORK"
+rm -f "$WORK/failed"
+nrun=0
+printf '{\n  "scenarios": [' > "$RESULT"
+
+echo "$SCENARIOS" | while read -r name args; do
+	[ -z "$name" ] && continue
+	out=$WORK/$name.txt
+	t0=$(date +%s.%N)
+	# shellcheck disable=SC2086
+	case $args in
+	@range\ *) run_range "$out" ${args#@range } ;;
+	@resume\ *) run_resume "$out" ${args#@resume } ;;
+	@fail\ *) run_fail "$out" ${args#@fail } ;;
+	*) "$EXE" $args -o "$out" ;;
+	esac > "$WORK/$name.log" 2>&1
+	ret=$?
+	t1=$(date +%s.%N)
+	frames=$(sed -n 's/^# SCPos:\([0-9]*\) .*/\1/p' "$out" 2>/dev/null | tail -1)
+	frames=$(( ${frames:-0} + 1 ))
+	fps=$(awk -v f="$frames" -v a="$t0" -v b="$t1" 'BEGIN { d = b - a; if (d <= 0) d = 1e-6; printf "%.1f", f / d }')
+	sec=$(awk -v a="$t0" -v b="$t1" 'BEGIN { printf "%.3f", b - a }')
+
+	if [ "${args#@fail }" != "$args" ]; then
+		status=ok
+		[ $ret -ne 0 ] && status=error
+	elif [ "$UPDATE" = "--update" ]; then
+		cp "$out" "$GOLDEN/$name.txt"
+		status=updated
+	elif [ $ret -ne 0 ]; then
+		status=error
+	elif cmp -s "$out" "$GOLDEN/$name.txt"; then
+		status=ok
+	else
+		status=NG
+		diff "$GOLDEN/$name.txt" "$out"
+	fi
+	printf '%-14s %-7s %8d frames %8s s %10s fps\n' "$name" "$status" "$frames" "$sec" "$fps"
+
+	[ $nrun -gt 0 ] && printf ',' >> "$RESULT"
+	printf '\n    {"name": "%s", "status": "%s", "frames": %d, "sec": %s, "fps": %s}' \
+		"$name" "$status" "$frames" "$sec" "$fps" >> "$RESULT"
+	nrun=$((nrun + 1))
+	case $status in
+	ok|updated) ;;
+	*) echo "$name" >> "$WORK/failed" ;;
+	esac
+done
+printf '\n  ]\n}\n' >> "$RESULT"
+
+if [ -s "$WORK/failed" ]; then
+	echo "check failed: $(cat "$WORK/failed" | tr '\n' ' ')"
+	rm -f "$WORK/failed"
+	exit 1
+fi
+echo "check passed."
+exit 0
@@ -0,0 +1,205 @@
+// 検索途中の状態の保存と再開（--checkpoint / --resume）
+// 出力ファイル名に".ckpt"を付けたファイルに、ループ位置・区間をまたぐ状態・出力済みバイト数を保存する。
+// 再開時は入力の識別情報と出力済み部分のハッシュを確認し、出力を保存時点まで切り詰めてから続ける。
+#ifndef __CHECKPOINT__
+#define __CHECKPOINT__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "source.h"
+#include "chapter.h"
+#include "stats.h"
+
+// FNV-1a 64bit
+inline uint64_t ckpt_hash(uint64_t h, const void *data, size_t size) {
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i=0; i<size; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+#define CKPT_HASH_INIT 0xcbf29ce484222325ULL
+// --checkpoint-stopで中断した時の終了コード
+#define CKPT_STOP_EXIT 3
+
+class ChapterCheckpoint : public ScanCheckpoint {
+	std::string _path;			// チェックポイントファイル
+	std::string _out_path;		// 出力ファイル名
+	std::string _fingerprint;	// 入力と設定の識別情報
+	FILE *_out;					// 出力ファイル
+	double _interval;			// 保存間隔（秒）
+	double _last;				// 前回保存時刻
+	int _stop;					// このフレーム以降で保存して中断（確認用、-1=しない）
+
+	// 出力ファイルの先頭sizeバイトのハッシュ
+	static bool hash_file(FILE *f, int64_t size, uint64_t *h) {
+		*h = CKPT_HASH_INIT;
+		rewind(f);
+		char buf[4096];
+		int64_t rest = size;
+		while (rest > 0) {
+			size_t len = (size_t)min((int64_t)sizeof(buf), rest);
+			if (fread(buf, 1, len, f) != len) {
+				return false;
+			}
+			*h = ckpt_hash(*h, buf, len);
+			rest -= len;
+		}
+		return true;
+	}
+
+	void save(const ScanState &st) {
+		fflush(_out);
+		int64_t offset = ftello(_out);
+		uint64_t h = CKPT_HASH_INIT;
+		FILE *fin = fopen(_out_path.c_str(), "rb");
+		if (fin == NULL || hash_file(fin, offset, &h) == false) {
+			if (fin) fclose(fin);
+			return;
+		}
+		fclose(fin);
+
+		// 書き込み途中で止まっても前回の内容が残るよう、別名で書いてから置き換える
+		std::string tmp = _path + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "w");
+		if (f == NULL) {
+			return;
+		}
+		fprintf(f, "# chapter_exe checkpoint\n");
+		fprintf(f, "fingerprint=%s\n", _fingerprint.c_str());
+		fprintf(f, "state=%d %d %d %d %d %lld %016llx\n", st.i, st.seri, st.scene.idx,
+			st.scene.lastmute_scpos, st.scene.lastmute_marker, (long long)offset, (unsigned long long)h);
+		fclose(f);
+		remove(_path.c_str());
+		rename(tmp.c_str(), _path.c_str());
+	}
+
+public:
+	ChapterCheckpoint(const char *out, const std::string &fingerprint, double interval)
+		: _path(std::string(out) + ".ckpt"), _out_path(out), _fingerprint(fingerprint), _out(NULL),
+		  _interval(interval), _last(0), _stop(-1) { }
+
+	// 入力と設定の識別情報（名前・大きさ・設定値と先頭・中央・末尾フレームの内容）
+	static std::string make_fingerprint(Source *video, Source *audio, const char *avsv, const char *avsa,
+		const ChapterParam &param, const SceneParam &sp, int thin_audio_read, int debug)
+	{
+		INPUT_INFO &vii = video->get_input_info();
+		INPUT_INFO &aii = audio->get_input_info();
+		int n = vii.n;
+		int w = vii.format->biWidth & 0xFFFFFFF0;
+		int h = vii.format->biHeight & 0xFFFFFFF0;
+		uint64_t hash = CKPT_HASH_INIT;
+		std::vector<short> buf(AUDIO_BUF_SIZE);
+		int frames[3] = { 0, n / 2, n - 1 };
+		for (int k=0; k<3; k++) {
+			int naudio = audio->read_audio(frames[k], &buf[0]);
+			int align = aii.audio_format->nBlockAlign;
+			if (align <= 0) {
+				align = aii.audio_format->nChannels * (int)sizeof(short);
+			}
+			size_t len = (size_t)max(0, min(naudio * align, (int)(buf.size() * sizeof(short))));
+			hash = ckpt_hash(hash, &buf[0], len);
+		}
+		std::vector<unsigned char> luma(w * h);
+		if (n > 0 && video->read_video_y8(n / 2, &luma[0])) {
+			hash = ckpt_hash(hash, &luma[0], luma.size());
+		}
+
+		char tmp[320];
+		sprintf(tmp, "\tn=%d\tsize=%dx%d\tfps=%d/%d\taudio=%d\tm=%d\ts=%d\tb=%d\te=%d\troi=%d\tcoarse=%d\tpict=%d\tthin=%d\tdebug=%d\thash=%016llx",
+			n, w, h, vii.rate, vii.scale, aii.audio_n, param.setmute, param.setseri, param.breakmute, param.extendmute, sp.roi, sp.coarse, sp.picture,
+			(thin_audio_read > 0) ? 1 : 0, debug, (unsigned long long)hash);
+		return std::string("v=") + avsv + "\ta=" + avsa + tmp;
+	}
+
+	// 保存済みの状態を読み込む
+	// 戻り値 : 1=再開可能 0=チェックポイントなし -1=入力・出力が一致しない
+	int load(ScanState *st, int64_t *offset) {
+		FILE *f = fopen(_path.c_str(), "r");
+		if (f == NULL) {
+			return 0;
+		}
+		std::string fingerprint;
+		bool has_state = false;
+		unsigned long long h = 0;
+		char line[4096];
+		while (fgets(line, sizeof(line), f)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (strncmp(line, "fingerprint=", 12) == 0) {
+				fingerprint = line + 12;
+			} else if (strncmp(line, "state=", 6) == 0) {
+				long long off;
+				has_state = (sscanf(line + 6, "%d %d %d %d %d %lld %llx", &st->i, &st->seri, &st->scene.idx,
+					&st->scene.lastmute_scpos, &st->scene.lastmute_marker, &off, &h) == 7);
+				*offset = off;
+			}
+		}
+		fclose(f);
+		if (has_state == false) {
+			return 0;
+		}
+		if (fingerprint != _fingerprint) {
+			fprintf(stderr, "checkpoint: input or settings differ from %s\n", _path.c_str());
+			return -1;
+		}
+		// 出力済み部分が保存時と同じか確認
+		uint64_t hout;
+		FILE *fo = fopen(_out_path.c_str(), "rb");
+		bool ok = (fo != NULL && hash_file(fo, *offset, &hout) && hout == h);
+		if (fo) fclose(fo);
+		if (ok == false) {
+			fprintf(stderr, "checkpoint: output file %s was modified\n", _out_path.c_str());
+			return -1;
+		}
+		return 1;
+	}
+
+	// 出力ファイルを保存時点の長さに切り詰めて追記用に開く
+	static FILE *open_resume(const char *out, int64_t offset) {
+		FILE *f = fopen(out, "r+");
+		if (f == NULL) {
+			return NULL;
+		}
+		if (ftruncate(fileno(f), offset) != 0) {
+			fclose(f);
+			return NULL;
+		}
+		fseeko(f, offset, SEEK_SET);
+		return f;
+	}
+
+	void set_output(FILE *out) {
+		_out = out;
+		_last = stat_clock(CLOCK_MONOTONIC);
+	}
+
+	// 指定フレームで強制終了された状態を作る（--checkpoint-stop、make checkの再開確認用）
+	void set_stop(int frame) {
+		_stop = frame;
+	}
+
+	// ScanCheckpoint
+	void update(const ScanState &st) {
+		double now = stat_clock(CLOCK_MONOTONIC);
+		if (_stop >= 0 && st.i >= _stop) {
+			save(st);
+			fprintf(stderr, "checkpoint: stopped at frame %d\n", st.i);
+			_exit(CKPT_STOP_EXIT);
+		}
+		if (now - _last >= _interval) {
+			save(st);
+			_last = now;
+		}
+	}
+
+	// 最後まで出力できたら不要なので削除
+	void remove_file() {
+		remove(_path.c_str());
+	}
+};
+
+#endif
@@ -29,4 +29,10 @@ typedef struct
 
 #define WAVE_FORMAT_PCM	0x0001
 #endif
+#ifndef WAVE_FORMAT_IEEE_FLOAT
+#define WAVE_FORMAT_IEEE_FLOAT	0x0003
+#endif
+#ifndef WAVE_FORMAT_EXTENSIBLE
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+#endif
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define __FAW__
 #include "compat.h"
 #include "source.h"
+#include <emmintrin.h>
 
 // FAWチェックと、FAWPreview.aufを使っての1フレームデコード
 class CFAW {
@@ -49,32 +50,62 @@ public:
 	}
 
 	// FAW開始地点を探す。1/2なFAWが見つかれば、以降はそれしか探さない。
+	// 先頭の1サンプルが一致する位置をSSE2で8サンプルずつ探し、候補だけ全体を比較する。
+	// 1/1と1/2は1回の走査で探す（1/1がどこかにあればそちらを優先）
 	// in: get_audio()で得た音声データ
 	// samples: get_audio() * ch数
 	// 戻り値：FAW開始位置のインデックス。なければ-1
 	int findFAW(short *in, int samples) {
 		// search for 72 F8 1F 4E 07 01 00 00
-		static unsigned char faw11[] = {0x72, 0xF8, 0x1F, 0x4E, 0x07, 0x01, 0x00, 0x00};
-		if (is_half == false) {
-			for (int j=0; j<samples - 30; ++j) {
-				if (memcmp(in+j, faw11, sizeof(faw11)) == 0) {
-					return j;
+		static const unsigned char faw11[] = {0x72, 0xF8, 0x1F, 0x4E, 0x07, 0x01, 0x00, 0x00};
+		// search for 00 F2 00 78 00 9F 00 CE 00 87 00 81 00 80 00 80
+		static const unsigned char faw12[] = {0x00, 0xF2, 0x00, 0x78, 0x00, 0x9F, 0x00, 0xCE,
+											  0x00, 0x87, 0x00, 0x81, 0x00, 0x80, 0x00, 0x80};
+		short head11, head12;
+		memcpy(&head11, faw11, sizeof(short));
+		memcpy(&head12, faw12, sizeof(short));
+		const __m128i v11 = _mm_set1_epi16(head11);
+		const __m128i v12 = _mm_set1_epi16(head12);
+
+		int end = samples - 30;
+		int half = -1;		// 最初の1/2なFAWの位置
+		for (int j=0; j<end; j+=8) {
+			bool need11 = (is_half == false);
+			bool need12 = (half < 0);
+			// 候補の位置（サンプルkは2kビット目）
+			int mask = 0;
+			if (j + 8 <= end) {
+				__m128i v = _mm_loadu_si128((const __m128i*)(in + j));
+				__m128i eq = _mm_setzero_si128();
+				if (need11) eq = _mm_or_si128(eq, _mm_cmpeq_epi16(v, v11));
+				if (need12) eq = _mm_or_si128(eq, _mm_cmpeq_epi16(v, v12));
+				mask = _mm_movemask_epi8(eq) & 0x5555;
+			} else {
+				for (int k=0; k<end-j; k++) {
+					if ((need11 && in[j+k] == head11) || (need12 && in[j+k] == head12)) {
+						mask |= 1 << (k*2);
+					}
 				}
 			}
-		}
-
-		// search for 00 F2 00 78 00 9F 00 CE 00 87 00 81 00 80 00 80
-		static unsigned char faw12[] = {0x00, 0xF2, 0x00, 0x78, 0x00, 0x9F, 0x00, 0xCE,
-										0x00, 0x87, 0x00, 0x81, 0x00, 0x80, 0x00, 0x80};
-
-		for (int j=0; j<samples - 30; ++j) {
-			if (memcmp(in+j, faw12, sizeof(faw12)) == 0) {
-				is_half = true;
-				return j;
+			for (int k=0; mask != 0; k++, mask >>= 2) {
+				if ((mask & 1) == 0) {
+					continue;
+				}
+				if (need11 && memcmp(in+j+k, faw11, sizeof(faw11)) == 0) {
+					return j + k;
+				}
+				if (need12 && half < 0 && memcmp(in+j+k, faw12, sizeof(faw12)) == 0) {
+					if (is_half) {
+						return j + k;
+					}
+					half = j + k;
+				}
 			}
 		}
-
-		return -1;
+		if (half >= 0) {
+			is_half = true;
+		}
+		return half;
 	}
 
 	// FAWPreview.aufを使ってFAWデータ1つを抽出＆デコードする
@@ -91,12 +122,14 @@ public:
 };
 
 // FAWデコードフィルタ
+// cacheを渡した時は、そこにあるフレームは_srcから読み直さない
 class FAWDecoder : public NullSource {
 	CFAW _cfaw;
 	Source *_src;
+	const AudioFrameCache *_cache;
 	WAVEFORMATEX fmt;
 public:
-	FAWDecoder(Source *src) : NullSource(), _src(src){
+	FAWDecoder(Source *src, const AudioFrameCache *cache = NULL) : NullSource(), _src(src), _cache(cache){
 		memset(&fmt, 0, sizeof(fmt));
 		fmt.wFormatTag = WAVE_FORMAT_PCM;		
 		fmt.nChannels = 2;
@@ -117,8 +150,15 @@ public:
 		return NullSource::release();
 	}
 
+	int refresh() {
+		return _src->refresh();
+	}
+
 	int read_audio(int frame, short *buf) {
-		int nsamples = _src->read_audio(frame, buf);
+		int nsamples;
+		if (_cache == NULL || _cache->read(frame, buf, &nsamples) == false) {
+			nsamples = _src->read_audio(frame, buf);
+		}
 		nsamples *= _src->get_input_info().audio_format->nChannels;
 
 		int j = _cfaw.findFAW(buf, nsamples);
@@ -0,0 +1,74 @@
+// 全フレームの動き検索結果の出力（--index）
+// ロゴ・CM検出など無音区間以外のシーンチェンジを使う処理向けに、全フレームの
+// mvec()の結果をバイナリで出力する。無音区間のチャプターも同じ検索結果から求める。
+//
+// ファイル形式（リトルエンディアン）
+//   ヘッダ 32バイト
+//     char  magic[8]    "CHAPIDX1"
+//     int32 n           フレーム数
+//     int32 rate, scale フレームレート
+//     int32 width, height 検索した輝度の大きさ（16の倍数）
+//     int32 flags       bit0: --roi  bit1: フレーム単位で検索（--picture frame）
+//   フレームごと 12バイト × n（frameとframe-1の比較、frame=0は自身と比較）
+//     int16 rate_sc, int16 flag_sc, int32 cmvec, int32 cmvec2
+#ifndef __INDEX__
+#define __INDEX__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "chapter.h"
+
+#define INDEX_MAGIC "CHAPIDX1"
+
+struct SceneIndexHeader {
+	char magic[8];
+	int32_t n;
+	int32_t rate, scale;
+	int32_t width, height;
+	int32_t flags;
+};
+
+struct SceneIndexEntry {
+	int16_t rate_sc;
+	int16_t flag_sc;
+	int32_t cmvec;
+	int32_t cmvec2;
+};
+
+// 動き検索結果の表（全フレーム分）をファイルに出力
+inline bool write_scene_index(const char *path, const SceneTable &table, int n, int rate, int scale,
+	int width, int height, const SceneParam &sp)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		return false;
+	}
+	SceneIndexHeader hdr;
+	memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.n = n;
+	hdr.rate = rate;
+	hdr.scale = scale;
+	hdr.width = width;
+	hdr.height = height;
+	hdr.flags = (sp.roi ? 1 : 0) | (sp.picture == FRAME_PICTURE ? 2 : 0);
+	bool ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1);
+
+	std::vector<SceneIndexEntry> ent(n > 0 ? n : 0);
+	for (int i=0; i<n; i++) {
+		const SceneInfo &si = table.scene[i];
+		ent[i].rate_sc = (int16_t)std::max(-32768, std::min(32767, si.rate_sc));
+		ent[i].flag_sc = (int16_t)si.flag_sc;
+		ent[i].cmvec = si.cmvec;
+		ent[i].cmvec2 = si.cmvec2;
+	}
+	if (n > 0) {
+		ok = ok && (fwrite(&ent[0], sizeof(SceneIndexEntry), n, f) == (size_t)n);
+	}
+	ok = (fclose(f) == 0) && ok;
+	return ok;
+}
+
+#endif
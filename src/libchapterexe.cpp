@@ -0,0 +1,186 @@
+// libchapterexe.cpp : push形式のC API
+//
+// 入力済みフレームは直近 setseri+extendmute+3 枚だけ保持し、
+// 無音が setseri フレーム続いた時点で区間の計算開始位置まで遡って動き検索を行う。
+// 無音区間の確定と判定は chapter.cpp の ChapterStream をそのまま使う。
+// C++の例外（メモリ不足など）はAPIの外に出さず、戻り値で失敗を返す。
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <new>
+#include "libchapterexe.h"
+#include "chapter.h"
+
+#ifndef _WIN32
+#include <malloc.h>
+#define _aligned_malloc(a,b) memalign(b,a)
+#define _aligned_free free
+#endif
+
+struct chapterexe : public SceneReader, public SceneWriter {
+	ChapterStream _stream;
+	int _setmute;
+	int _w, _h;
+	std::vector<unsigned char*> _ring;		// 輝度（フレーム番号 % _ring.size()）
+	std::map<int, SceneInfo> _scene;		// 動き検索結果
+
+	chapterexe_mute_func _on_mute;
+	chapterexe_scpos_func _on_scpos;
+	void *_user;
+
+	chapterexe(const ChapterParam &param, int w, int h, chapterexe_mute_func on_mute, chapterexe_scpos_func on_scpos, void *user)
+		: _stream(param, this, this), _setmute(param.setmute), _w(w), _h(h), _on_mute(on_mute), _on_scpos(on_scpos), _user(user)
+	{
+		_ring.resize(param.setseri + param.extendmute + 3, NULL);
+		for (size_t i=0; i<_ring.size(); i++) {
+			_ring[i] = (unsigned char*)_aligned_malloc(_w * _h, 32);
+			if (_ring[i] == NULL) {
+				free_ring();
+				throw std::bad_alloc();
+			}
+		}
+	}
+	~chapterexe() {
+		free_ring();
+	}
+
+	void free_ring() {
+		for (size_t i=0; i<_ring.size(); i++) {
+			if (_ring[i]) {
+				_aligned_free(_ring[i]);
+				_ring[i] = NULL;
+			}
+		}
+	}
+
+	unsigned char *ring(int frame) {
+		return _ring[frame % _ring.size()];
+	}
+
+	// 動き検索（計算済みなら何もしない）
+	void measure(int frame) {
+		if (_scene.count(frame)) {
+			return;
+		}
+		int bef = (frame > 0) ? frame - 1 : 0;
+		SceneInfo si;
+		measure_scene(&si, ring(frame), ring(bef), _w, _h, frame);
+		_scene[frame] = si;
+	}
+
+	// SceneReader
+	bool get_scene(int frame, SceneInfo *si) {
+		std::map<int, SceneInfo>::iterator it = _scene.find(frame);
+		if (it == _scene.end()) {
+			return false;
+		}
+		*si = it->second;
+		return true;
+	}
+
+	// SceneWriter
+	void write_mute(int idx, int start_fr, int seri) {
+		if (_on_mute) {
+			chapterexe_mute m;
+			m.idx = idx;
+			m.start_frame = start_fr;
+			m.frames = seri;
+			_on_mute(_user, &m);
+		}
+	}
+	void write_scpos(const ScenePos &sp) {
+		if (_on_scpos) {
+			chapterexe_scpos s;
+			s.idx = sp.idx;
+			s.start_frame = sp.start_fr;
+			s.frames = sp.seri;
+			s.pos = sp.pos;
+			s.rev_pos = sp.rev_pos;
+			s.pre_pos = sp.pre_pos;
+			s.rate = sp.rate;
+			s.mark = sp.mark;
+			_on_scpos(_user, &s);
+		}
+	}
+
+	void push(const unsigned char *luma, int pitch, const short *pcm, int nsamples) {
+		unsigned char *dst = ring(_stream.frames());
+		for (int y=0; y<_h; y++) {
+			memcpy(dst + y * _w, luma + y * pitch, _w);
+		}
+		_stream.add(audio_is_mute(pcm, nsamples, _setmute));
+
+		// 保持している間に動き検索
+		int from, to;
+		if (_stream.scene_needed(&from, &to)) {
+			for (int f=from; f<=to; f++) {
+				measure(f);
+			}
+		}
+		_stream.flush();
+		_scene.erase(_scene.begin(), _scene.lower_bound(_stream.scene_keep()));
+	}
+
+	void finish() {
+		_stream.finish();
+		_scene.clear();
+	}
+};
+
+
+void chapterexe_param_default(chapterexe_param *param) {
+	param->setmute = 50;
+	param->setseri = 10;
+	param->breakmute = 60;
+	param->extendmute = 1;
+}
+
+chapterexe *chapterexe_create(const chapterexe_param *param, int width, int height,
+	chapterexe_mute_func on_mute, chapterexe_scpos_func on_scpos, void *user)
+{
+	int w = width & 0xFFFFFFF0;
+	int h = height & 0xFFFFFFF0;
+	if (param == NULL || w <= 0 || h <= 0 || param->setseri < 1 || param->extendmute < 0 || param->breakmute <= 0) {
+		return NULL;
+	}
+	ChapterParam cp;
+	cp.setmute = param->setmute;
+	cp.setseri = param->setseri;
+	cp.breakmute = param->breakmute;
+	cp.extendmute = param->extendmute;
+	try {
+		return new chapterexe(cp, w, h, on_mute, on_scpos, user);
+	} catch (...) {
+		return NULL;
+	}
+}
+
+int chapterexe_push_frame(chapterexe *ce, const unsigned char *luma, int pitch, const short *pcm, int nsamples) {
+	if (ce == NULL || luma == NULL || pitch < ce->_w || (pcm == NULL && nsamples > 0)) {
+		return -1;
+	}
+	try {
+		ce->push(luma, pitch, pcm, nsamples);
+	} catch (...) {
+		return -1;
+	}
+	return 0;
+}
+
+int chapterexe_finish(chapterexe *ce) {
+	if (ce == NULL) {
+		return -1;
+	}
+	try {
+		ce->finish();
+	} catch (...) {
+		return -1;
+	}
+	return 0;
+}
+
+void chapterexe_destroy(chapterexe *ce) {
+	delete ce;
+}
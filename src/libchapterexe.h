@@ -0,0 +1,80 @@
+// libchapterexe : chapter_exeの検出処理を組み込むためのC API
+//
+// デコード済みの輝度データとPCMを１フレームずつ渡すと、無音区間とシーンチェンジ位置を
+// コールバックで通知する。結果はchapter_exe（--serial指定時と同じ検索）の出力と一致する。
+//
+//   chapterexe_param param;
+//   chapterexe_param_default(&param);
+//   chapterexe *ce = chapterexe_create(&param, width, height, on_mute, on_scpos, user);
+//   for (各フレーム) chapterexe_push_frame(ce, luma, pitch, pcm, nsamples);
+//   chapterexe_finish(ce);
+//   chapterexe_destroy(ce);
+//
+// 無音区間は確定するまで（区間後 max(setseri, extendmute)+1 フレーム程度）通知が遅れる。
+// 保持する画像は setseri+extendmute+3 フレーム分のみ。
+#ifndef __LIBCHAPTEREXE__
+#define __LIBCHAPTEREXE__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chapterexe chapterexe;
+
+// 検索設定（chapter_exeの-m -s -b -eに対応）
+typedef struct {
+	int setmute;		// 無音判定閾値（1〜2^15）
+	int setseri;		// 最低無音フレーム数
+	int breakmute;		// 無音シーン検索間隔フレーム数
+	int extendmute;		// 無音前後検索拡張フレーム数
+} chapterexe_param;
+
+// 無音区間
+typedef struct {
+	int idx;			// 無音区間通算番号（1-）
+	int start_frame;	// 無音開始フレーム
+	int frames;			// 無音フレーム数
+} chapterexe_mute;
+
+// シーンチェンジ位置（chapter_exe出力のCHAPTERxxNAMEの内容）
+typedef struct {
+	int idx;			// 無音区間通算番号（1-）
+	int start_frame;	// 無音開始フレーム
+	int frames;			// 無音フレーム数
+	int pos;			// シーンチェンジ地点
+	int rev_pos;		// シーンチェンジ後の位置（SCPosの１つ目）
+	int pre_pos;		// シーンチェンジ前の位置（SCPosの２つ目）
+	int rate;			// シーンチェンジ判定値
+	const char *mark;	// マーク（UTF-8、コールバック内でのみ有効）
+} chapterexe_scpos;
+
+typedef void (*chapterexe_mute_func)(void *user, const chapterexe_mute *mute);
+typedef void (*chapterexe_scpos_func)(void *user, const chapterexe_scpos *scpos);
+
+// chapter_exeと同じ初期値を設定
+void chapterexe_param_default(chapterexe_param *param);
+
+// 作成（width/heightは輝度の大きさ、16の倍数に切り捨てて処理）
+// 失敗時はNULL
+chapterexe *chapterexe_create(const chapterexe_param *param, int width, int height,
+	chapterexe_mute_func on_mute, chapterexe_scpos_func on_scpos, void *user);
+
+// １フレーム分の入力
+// luma : 輝度（8bit）、pitch : １行のバイト数
+// pcm : 16bit PCM、nsamples : 無音判定に使う値の数
+//       （chapter_exeと同じく先頭nsamples個で判定するので、ステレオでも１chあたりのサンプル数を渡す）
+// 成功時は0
+int chapterexe_push_frame(chapterexe *ce, const unsigned char *luma, int pitch, const short *pcm, int nsamples);
+
+// 入力終了（未通知の無音区間を確定させる）
+// 成功時は0
+int chapterexe_finish(chapterexe *ce);
+
+// 解放
+void chapterexe_destroy(chapterexe *ce);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
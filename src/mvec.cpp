@@ -11,15 +11,15 @@
 #else
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 #endif
 #include <stdlib.h>
 #include <limits.h>
 #include <stdio.h>
+#include "mvec.h"
 
 #define MAX_LINEOBJ		20		// 固定ライン検出する画面周囲からの検索範囲
 
-#define FRAME_PICTURE	1
-#define FIELD_PICTURE	2
 #define MAX_SEARCH_EXTENT 32	//全探索の最大探索範囲。+-この値まで。
 #define RATE_SCENE_CHANGE 100	//シーンチェンジと判定する割合x1000。指定値/1000以上の変化があればシーンチェンジとする
 #define RATE_SCENE_CHGLOW 50	//検出不明が多い時にシーンチェンジと判定する割合x1000。
@@ -37,18 +37,13 @@
 //---------------------------------------------------------------------
 //void make_motion_lookup_table();
 //BOOL mvec(unsigned char* current_pix,unsigned char* bef_pix,int* vx,int* vy,int lx,int ly,int threshold,int pict_struct,int SC_level);
-int mvec(int *mvec1,int *mvec2,int *flag_sc,unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int threshold,int pict_struct, int nframe);
-int search_change(int* val, unsigned char* pc, unsigned char* pb, int lx, int ly, int x, int y, int thres_fine, int thres_sc, int pict_struct);
-int tree_search(unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int *vx,int *vy,int search_block_x,int search_block_y,int min,int pict_struct, int method);
-int full_search(unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int *vx,int *vy,int search_block_x,int search_block_y,int min,int pict_struct, int search_extent);
-int dist( unsigned char *p1, unsigned char *p2, int lx, int distlim, int block_height );
-int maxmin_block( unsigned char *p, int lx, int block_height );
-int avgdist( int *avg, unsigned char *psrc, int lx, int block_height );
+// 各関数の定義はmvec.hを参照
 
 //---------------------------------------------------------------------
 //		グローバル変数
 //---------------------------------------------------------------------
-int	block_height, lx2;
+// mvec()ごとに設定する値なのでスレッドごとに持つ（--shardsで並列に呼ばれるため）
+thread_local int	block_height, lx2;
 
 
 //---------------------------------------------------------------------
@@ -56,7 +51,20 @@ int	block_height, lx2;
 //---------------------------------------------------------------------
 //[ru] 動きベクトルの合計を返す
 //返り値はシーンチェンジ判定数値に変更
-int tree=0, full=0;
+thread_local MvecCount mvec_count;
+static std::atomic<int64_t> done_tree(0), done_full(0), done_tree_outer(0);	// 終了したスレッドの合計
+
+MvecCount::~MvecCount() {
+	done_tree += tree;
+	done_full += full;
+	done_tree_outer += tree_outer;
+}
+
+void mvec_count_total(int64_t *tree, int64_t *full, int64_t *tree_outer) {
+	*tree = done_tree + mvec_count.tree;
+	*full = done_full + mvec_count.full;
+	*tree_outer = done_tree_outer + mvec_count.tree_outer;
+}
 int mvec(
 		  int *mvec1,					//インターレースで動きが多い側の動き結果を格納（出力）
 		  int *mvec2,					//インターレースで動きが少ない側の動き結果を格納（出力）
@@ -67,7 +75,8 @@ int mvec(
 		  int ly,						//画像の縦幅
 		  int threshold,				//検索精度。(100-fp->track[1])*50 …… 50は適当な値。
 		  int pict_struct,				//"1"ならフレーム処理、"2"ならフィールド処理
-		  int nframe )					// フレーム番号。デバッグのみに使用
+		  int nframe,					// フレーム番号。デバッグのみに使用
+		  const MvecRoi *roi )			// 検索範囲（NULLなら全体）
 {
 	int x, y;
 	unsigned char *p1, *p2;
@@ -125,15 +134,31 @@ int mvec(
 				int val_calc;						// 動きベクトル量保持
 				unsigned char *pc, *pp;				// 画像先頭位置
 
+				// 検索範囲外（黒帯）のブロックは数えない
+				if (roi && (x + 16 <= roi->x0 || x >= roi->x1 || y - i + 16 <= roi->y0 || y - i >= roi->y1)){
+					p1+=16;
+					p2+=16;
+					continue;
+				}
+
 				// 中心領域検出
 				if (y >= ly*3/16 && y < ly - (ly*3/16) &&
 					x >= lx*3/16 && x < lx - (lx*3/16)){
 					center_area = 1;
 				}
 
+				// 同位置でのフレーム間の絶対値差（search_change()でも使う）
+				int dist0 = dist(p1, p2, lx2, INT_MAX, block_height);
+
 				// １フレーム内の差分絶対値合計取得
 				ddist1 = avgdist(&avg1, p1, lx2, block_height);		// 現フレームの平均からの差分絶対値合計
-				ddist2 = avgdist(&avg2, p2, lx2, block_height);		// 前フレームの平均からの差分絶対値合計
+				if (dist0 == 0){						// 前後フレームが同じ（ロゴ・黒帯など固定部分）なら同じ値
+					ddist2 = ddist1;
+					avg2 = avg1;
+				}
+				else{
+					ddist2 = avgdist(&avg2, p2, lx2, block_height);	// 前フレームの平均からの差分絶対値合計
+				}
 				// 前後フレームの状態を分類
 				if (ddist1 <= threshold && ddist2 > thr_blank && ddist1 * 2 <= ddist2){
 					lowtype = 1;								// 現フレームが空白に近い
@@ -185,7 +210,7 @@ int mvec(
 				}
 
 				// シーンチェンジ検出
-				nrank_sc = search_change(&val_calc, pc, pp, lx, ly, x, y, th_fine, threshold, pict_struct);
+				nrank_sc = search_change(&val_calc, pc, pp, lx, ly, x, y, th_fine, threshold, pict_struct, dist0);
 
 				// シーンチェンジ結果を分類し、分類結果に+1カウント
 				// cnt_scは検出に必須、それ以外は微調整用
@@ -462,7 +487,8 @@ int search_change(
 	int y,					//検索位置
 	int thres_fine,			//比較閾値（一致判定）
 	int thres_sc,			//比較閾値（シーンチェンジ判定）
-	int pict_struct)		//"1"ならフレーム処理、"2"ならフィールド処理
+	int pict_struct,		//"1"ならフレーム処理、"2"ならフィールド処理
+	int dist0)				//同位置でのフレーム間の絶対値差（計算済みの時、未計算なら-1）
 {
 	int method = 0;			//検索の簡易化（0:探索多回数 1:２分探索 2:検索省略）
 	int n_sc = 0;
@@ -470,7 +496,7 @@ int search_change(
 	int vy = 0;
 
 	//同位置でのフレーム間の絶対値差。
-	int min = dist( pc, pp, lx2, INT_MAX, block_height );
+	int min = (dist0 >= 0) ? dist0 : dist( pc, pp, lx2, INT_MAX, block_height );
 	if (min <= thres_fine){		//フレーム間の絶対値差が最初から小さければ簡略化
 		//method = 1;		//動き情報も考慮に入れるならこちら
 		method = 2;			//速度優先ならこちら
@@ -513,7 +539,8 @@ int tree_search(unsigned char* current_pix,	//現フレームの輝度。8ビッ
 				int pict_struct,			//"1"ならフレーム処理、"2"ならフィールド処理
 				int method)					//検索の簡易化（0:探索多回数 1:２分探索 2:検索省略 3:探索多回数外周）
 {
-	tree++;
+	mvec_count.tree++;
+	if (method == 3) mvec_count.tree_outer++;
 	int dx, dy, ddx=0, ddy=0, xs=0, ys;
 	int d;
 	int x,y;
@@ -644,7 +671,7 @@ int full_search(unsigned char* current_pix,	//現フレームの輝度。8ビッ
 				int pict_struct,			//"1"ならフレーム処理、"2"ならフィールド処理
 				int search_extent)			//探索範囲。
 {
-	full++;
+	mvec_count.full++;
 	int dx, dy, ddx=0, ddy=0;
 	int d;
 	int dthres;
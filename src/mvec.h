@@ -0,0 +1,37 @@
+// mvec.cpp 動き検索処理の関数定義
+#ifndef __MVEC__
+#define __MVEC__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_PICTURE	1
+#define FIELD_PICTURE	2
+
+// 動き検索するブロックの範囲（画素単位、[x0, x1)×[y0, y1)に一部でもかかるブロックのみ検索）
+struct MvecRoi {
+	int x0, y0, x1, y1;
+};
+
+int mvec(int *mvec1,int *mvec2,int *flag_sc,unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int threshold,int pict_struct, int nframe, const MvecRoi *roi = NULL);
+int search_change(int* val, unsigned char* pc, unsigned char* pb, int lx, int ly, int x, int y, int thres_fine, int thres_sc, int pict_struct, int dist0 = -1);
+int tree_search(unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int *vx,int *vy,int search_block_x,int search_block_y,int min,int pict_struct, int method);
+int full_search(unsigned char* current_pix,unsigned char* bef_pix,int lx,int ly,int *vx,int *vy,int search_block_x,int search_block_y,int min,int pict_struct, int search_extent);
+int dist( unsigned char *p1, unsigned char *p2, int lx, int distlim, int block_height );
+int maxmin_block( unsigned char *p, int lx, int block_height );
+int avgdist( int *avg, unsigned char *psrc, int lx, int block_height );
+
+// mvec()内で設定される検索用の値（mvec()を通さず個別関数を呼ぶ時は事前に設定）
+extern thread_local int block_height, lx2;
+// 検索関数の呼び出し回数（tree_outerはtree_searchの外周探索(method 3)の回数）
+// 検索の内側で共有の値を書き換えないようスレッドごとに数え、スレッド終了時に全体に加える
+struct MvecCount {
+	int64_t tree, full, tree_outer;
+	MvecCount() : tree(0), full(0), tree_outer(0) { }
+	~MvecCount();
+};
+extern thread_local MvecCount mvec_count;
+// 終了したスレッドと呼び出したスレッドの合計
+void mvec_count_total(int64_t *tree, int64_t *full, int64_t *tree_outer);
+
+#endif
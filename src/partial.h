@@ -0,0 +1,214 @@
+// 範囲を限定した解析（--range）と部分ファイルの結合（merge）
+// --range start:end は[start, end)の無音判定と、その範囲の無音区間で使う可能性のある動き検索結果を
+// 部分ファイルに出力する。範囲の境界にかかる無音は長さが分からないので、長さに関係なく前後の分も求めておく。
+// "chapter_exe merge -o 出力 部分ファイル..." で全範囲を結合し、通常と同じ判定で出力する。
+#ifndef __PARTIAL__
+#define __PARTIAL__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "source_reader.h"
+#include "chapter.h"
+
+class PartialResult {
+	struct Scene {
+		int frame;
+		SceneInfo si;
+		bool operator<(const Scene &o) const { return frame < o.frame; }
+	};
+	struct Run {
+		int start;		// 無音開始フレーム
+		int end;		// 無音終了フレーム（含まない）
+	};
+
+public:
+	std::string fingerprint;	// 入力と設定の識別情報（ファイル名は含めない）
+	int n;						// 全フレーム数
+	int rate, scale;
+	int debug;
+	ChapterParam param;
+	SceneParam sp;
+	int start, end;				// 解析範囲[start, end)
+	std::vector<Run> mute;		// 範囲内の無音
+	std::vector<Scene> scene;	// 動き検索結果
+
+	PartialResult() : n(0), rate(0), scale(0), debug(0), start(0), end(0) {
+		memset(&param, 0, sizeof(param));
+	}
+
+	// [start, end)を解析
+	void analyze(Source *video, Source *audio) {
+		SourceMuteReader mreader(audio, param.setmute);
+		SourceSceneReader sreader(video, sp);
+		int ext = param.extendmute;
+
+		//--- 無音判定 ---
+		std::vector<int> range;		// 動き検索範囲（開始・終了の組）
+		int seri = 0;
+		for (int i=start; i<=end; i++) {
+			bool m = (i < end) ? mreader.is_mute(i) : false;
+			if (m) {
+				seri++;
+				continue;
+			}
+			if (seri > 0) {
+				Run r;
+				r.start = i - seri;
+				r.end = i;
+				mute.push_back(r);
+				// 範囲内で長さが足りるか、境界にかかっている無音は動き検索の対象
+				if (seri >= param.setseri || (r.start == start && start > 0) || (r.end == end && end < n)) {
+					range.push_back(max(r.start - ext - 1, 0));
+					range.push_back(min(r.end + ext + 1, n - 1));
+				}
+			}
+			seri = 0;
+		}
+
+		//--- 動き検索（重なった範囲は１回だけ） ---
+		int last = -1;
+		for (size_t k=0; k<range.size(); k+=2) {
+			// 境界にかかる無音は長さが分からないが、--coarseの結果は通常と同じなので長い無音として扱う
+			sreader.set_range(range[k], range[k+1], true);
+			for (int x=max(range[k], last + 1); x<=range[k+1]; x++) {
+				Scene s;
+				s.frame = x;
+				sreader.get_scene(x, &s.si);
+				scene.push_back(s);
+				last = x;
+			}
+		}
+	}
+
+	void write(FILE *f) {
+		fprintf(f, "# chapter_exe partial\n");
+		fprintf(f, "fingerprint=%s\n", fingerprint.c_str());
+		fprintf(f, "info=%d %d %d %d %d %d %d %d\n", n, rate, scale,
+			param.setmute, param.setseri, param.breakmute, param.extendmute, debug);
+		fprintf(f, "range=%d %d\n", start, end);
+		for (size_t k=0; k<mute.size(); k++) {
+			fprintf(f, "M %d %d\n", mute[k].start, mute[k].end);
+		}
+		for (size_t k=0; k<scene.size(); k++) {
+			const SceneInfo &si = scene[k].si;
+			fprintf(f, "S %d %d %d %d %d\n", scene[k].frame, si.rate_sc, si.flag_sc, si.cmvec, si.cmvec2);
+		}
+		fflush(f);
+	}
+
+	bool read(const char *path) {
+		FILE *f = fopen(path, "r");
+		if (f == NULL) {
+			return false;
+		}
+		bool has_info = false, has_range = false;
+		char line[4096];
+		while (fgets(line, sizeof(line), f)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (strncmp(line, "fingerprint=", 12) == 0) {
+				fingerprint = line + 12;
+			} else if (strncmp(line, "info=", 5) == 0) {
+				has_info = (sscanf(line + 5, "%d %d %d %d %d %d %d %d", &n, &rate, &scale,
+					&param.setmute, &param.setseri, &param.breakmute, &param.extendmute, &debug) == 8);
+			} else if (strncmp(line, "range=", 6) == 0) {
+				has_range = (sscanf(line + 6, "%d %d", &start, &end) == 2);
+			} else if (line[0] == 'M') {
+				Run r;
+				if (sscanf(line + 1, "%d %d", &r.start, &r.end) == 2) {
+					mute.push_back(r);
+				}
+			} else if (line[0] == 'S') {
+				Scene s;
+				if (sscanf(line + 1, "%d %d %d %d %d", &s.frame, &s.si.rate_sc, &s.si.flag_sc, &s.si.cmvec, &s.si.cmvec2) == 5) {
+					scene.push_back(s);
+				}
+			}
+		}
+		fclose(f);
+		return has_info && has_range;
+	}
+
+	bool operator<(const PartialResult &o) const { return start < o.start; }
+
+	// 部分ファイルを結合して出力
+	static int merge(const char *out, const std::vector<const char*> &paths) {
+		std::vector<PartialResult> parts(paths.size());
+		for (size_t k=0; k<paths.size(); k++) {
+			if (parts[k].read(paths[k]) == false) {
+				printf("Error: cannot read partial file %s\n", paths[k]);
+				return -1;
+			}
+			const PartialResult &p0 = parts[0];
+			const PartialResult &p = parts[k];
+			if (p.fingerprint != p0.fingerprint || p.n != p0.n || p.rate != p0.rate || p.scale != p0.scale ||
+				p.debug != p0.debug || memcmp(&p.param, &p0.param, sizeof(ChapterParam)) != 0) {
+				printf("Error: %s is from a different input or settings.\n", paths[k]);
+				return -1;
+			}
+		}
+		if (parts.empty()) {
+			printf("Error: no partial file.\n");
+			return -1;
+		}
+		std::sort(parts.begin(), parts.end());
+		int n = parts[0].n;
+		int pos = 0;
+		for (size_t k=0; k<parts.size(); k++) {
+			if (parts[k].start != pos) {
+				printf("Error: frames %d - %d are missing.\n", pos, parts[k].start);
+				return -1;
+			}
+			pos = parts[k].end;
+		}
+		if (pos != n) {
+			printf("Error: frames %d - %d are missing.\n", pos, n);
+			return -1;
+		}
+
+		//--- 全範囲の表を作る ---
+		MuteTable mute;
+		mute.mute.assign(n, 0);
+		SceneTable scene;
+		scene.scene.resize(n);
+		scene.valid.assign(n, 0);
+		for (size_t k=0; k<parts.size(); k++) {
+			const PartialResult &p = parts[k];
+			for (size_t j=0; j<p.mute.size(); j++) {
+				for (int x=max(p.mute[j].start, 0); x<min(p.mute[j].end, n); x++) {
+					mute.mute[x] = 1;
+				}
+			}
+			for (size_t j=0; j<p.scene.size(); j++) {
+				int x = p.scene[j].frame;
+				if (x >= 0 && x < n) {
+					scene.scene[x] = p.scene[j].si;
+					scene.valid[x] = 1;
+				}
+			}
+		}
+		std::vector<int> frames;
+		list_scene_frames(&mute, parts[0].param, n, &frames);
+		for (size_t k=0; k<frames.size(); k++) {
+			if (scene.valid[frames[k]] == 0) {
+				printf("Error: scene data for frame %d is missing.\n", frames[k]);
+				return -1;
+			}
+		}
+
+		//--- 通常と同じ判定で出力 ---
+		FILE *fout = fopen(out, "w");
+		if (fout == NULL) {
+			printf("Error: output file open failed.\n");
+			return -1;
+		}
+		ChapterFileWriter writer(fout, parts[0].rate, parts[0].scale, parts[0].debug);
+		search_chapter(&mute, &scene, &writer, parts[0].param, n, -1, 0);
+		writer.write_end(n);
+		fclose(fout);
+		return 0;
+	}
+};
+
+#endif
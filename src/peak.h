@@ -0,0 +1,79 @@
+// フレームごとの音量最大値
+// 音量最大値を先に求めておけば、無音判定は閾値との比較だけになる（--set、--audio-threads）。
+// --audio-threadsでは全フレームを範囲に分け、範囲ごとにプールから借りた音声ソースと別スレッドで求める。
+// 無音区間の判定は求めた値から１スレッドで順に行うので、結果は順に読み込んだ時と一致する。
+#ifndef __PEAK__
+#define __PEAK__
+
+#include <vector>
+#include <thread>
+#include "source_reader.h"
+#include "chapter.h"
+#include "trace.h"
+#include "pool.h"
+
+// 音量最大値の表から無音判定
+class PeakMuteReader : public MuteReader {
+	const std::vector<int> &_peak;
+	int _mute;
+public:
+	PeakMuteReader(const std::vector<int> &peak, int mute) : _peak(peak), _mute(mute) { }
+
+	bool is_mute(int frame) {
+		return _peak[frame] <= _mute;
+	}
+};
+
+// [start, end)の音量最大値
+inline void read_peaks(Source *audio, int start, int end, int *peak) {
+	std::vector<short> buf(AUDIO_BUF_SIZE);
+	int type = audio_sample_type(audio);
+	for (int i=start; i<end; i++) {
+		StatScope st(ST_AUDIO);
+		int naudio = read_audio(audio, i, &buf[0]);
+		peak[i - start] = audio_peak(&buf[0], naudio, type);
+	}
+}
+
+// 全フレームの音量最大値を複数スレッドで求める
+class PeakScanner {
+	SourcePool *_pool;
+	int _n;
+	int _nthread;
+	ThreadError _error;
+
+	void scan(int start, int end, std::vector<int> *peak) {
+		TraceScope tr("peak_audio", "audio", start, end - start);
+		SourcePool::Input *in = NULL;
+		try {
+			in = _pool->acquire();
+			read_peaks(in->audio, start, end, &(*peak)[start]);
+		} catch (...) {
+			_error.set(std::current_exception());
+		}
+		if (in) {
+			_pool->release(in);
+		}
+	}
+
+public:
+	PeakScanner(SourcePool *pool, int n, int nthread) : _pool(pool), _n(n), _nthread(nthread < 1 ? 1 : nthread) { }
+
+	void run(std::vector<int> *peak) {
+		peak->assign(_n > 0 ? _n : 0, 0);
+		std::vector<std::thread> th;
+		for (int k=0; k<_nthread; k++) {
+			int start = (int)((int64_t)_n * k / _nthread);
+			int end = (int)((int64_t)_n * (k + 1) / _nthread);
+			if (start < end) {
+				th.push_back(std::thread(&PeakScanner::scan, this, start, end, peak));
+			}
+		}
+		for (size_t k=0; k<th.size(); k++) {
+			th[k].join();
+		}
+		_error.rethrow();
+	}
+};
+
+#endif
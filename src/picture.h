@@ -0,0 +1,125 @@
+// インターレースの検出（--picture auto）
+// 動き検索をフレーム単位（FRAME_PICTURE）で行ってよいかを、全体から均等に取り出したフレームで判定する。
+//   1. フレームプロパティ_FieldBasedがフィールド（1以上）のフレームがあればフィールド
+//   2. 16x16ブロックごとに隣のライン（別フィールド）との差と２ライン先（同じフィールド）との差を比べ、
+//      隣のラインとの差だけが大きいブロック（縞）が多いフレームがあればフィールド
+//   3. 全てのフレームに_FieldBased=0（プログレッシブ）があればフレーム
+//   4. プロパティがない時は、前のフレームとの差が大きいブロック（動き）が合わせて１フレーム分以上あればフレーム
+//      （インターレースの縞は動きがある所にしか出ないので、静止画ばかりでは縞がないことを確かめられない）
+// どれにも当たらなければフィールド。迷う時はフィールド（従来の処理）にする。
+#ifndef __PICTURE__
+#define __PICTURE__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include "source_reader.h"
+#include "mvec.h"
+
+// 判定に使うフレーム数
+#define PICTURE_SAMPLES 32
+// 縞とみなす隣のラインとの差（１画素あたりの平均）
+#define COMB_DIFF 6
+// 縞とみなす隣のラインとの差と２ライン先との差の比（/4）
+#define COMB_RATIO4 6
+// 縞のブロックがこの割合（1/COMB_BLOCKS_DIV）以上あればインターレースのフレーム
+#define COMB_BLOCKS_DIV 64
+// 動きとみなす前のフレームとの差（１画素あたりの平均）
+#define MOTION_DIFF 4
+
+// 縞になっている16x16ブロックの数
+inline int comb_blocks(const unsigned char *data, int w, int h) {
+	int count = 0;
+	for (int by=0; by+16<=h-2; by+=16) {
+		for (int bx=0; bx+16<=w; bx+=16) {
+			int d1 = 0, d2 = 0;
+			for (int y=by; y<by+16; y++) {
+				const unsigned char *p0 = data + w*y + bx;
+				const unsigned char *p1 = p0 + w;
+				const unsigned char *p2 = p1 + w;
+				for (int x=0; x<16; x++) {
+					d1 += abs(p0[x] - p1[x]);
+					d2 += abs(p0[x] - p2[x]);
+				}
+			}
+			if (d1 >= COMB_DIFF * 256 && d1 * 4 >= d2 * COMB_RATIO4) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+// 前のフレームとの差が大きい16x16ブロックの数
+inline int motion_blocks(const unsigned char *cur, const unsigned char *bef, int w, int h) {
+	int count = 0;
+	for (int by=0; by+16<=h; by+=16) {
+		for (int bx=0; bx+16<=w; bx+=16) {
+			int d = 0;
+			for (int y=by; y<by+16; y++) {
+				const unsigned char *p0 = cur + w*y + bx;
+				const unsigned char *p1 = bef + w*y + bx;
+				for (int x=0; x<16; x++) {
+					d += abs(p0[x] - p1[x]);
+				}
+			}
+			if (d >= MOTION_DIFF * 256) {
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+// 動き検索の画像構造（FRAME_PICTURE/FIELD_PICTURE）を判定
+inline int detect_picture(Source *video) {
+	INPUT_INFO &vii = video->get_input_info();
+	int w = vii.format->biWidth & 0xFFFFFFF0;
+	int h = vii.format->biHeight & 0xFFFFFFF0;
+	int nblocks = (w / 16) * ((h - 2) / 16);
+	if (vii.n <= 0 || nblocks <= 0) {
+		return FIELD_PICTURE;
+	}
+	std::vector<unsigned char> luma(w * h), bef(w * h);
+	int read = 0;
+	int progressive = 0;		// _FieldBased=0のフレーム数
+	int64_t moving = 0;			// 動きのあるブロック数
+	for (int k=0; k<PICTURE_SAMPLES; k++) {
+		int frame = (int)((int64_t)vii.n * (k + 1) / (PICTURE_SAMPLES + 1));
+		int fb = video->field_based(frame);
+		if (fb > 0) {
+			fprintf(stderr, "picture: field (_FieldBased at frame %d)\n", frame);
+			return FIELD_PICTURE;
+		}
+		if (fb == 0) {
+			progressive++;
+		}
+		// 前のフレームから順に読む
+		if (frame < 1 || read_video(video, frame - 1, &bef[0]) == false || read_video(video, frame, &luma[0]) == false) {
+			continue;
+		}
+		read++;
+		int comb = comb_blocks(&luma[0], w, h);
+		if (comb * COMB_BLOCKS_DIV >= nblocks) {
+			fprintf(stderr, "picture: field (combing at frame %d, %d/%d blocks)\n", frame, comb, nblocks);
+			return FIELD_PICTURE;
+		}
+		moving += motion_blocks(&luma[0], &bef[0], w, h);
+	}
+	if (read == 0) {
+		return FIELD_PICTURE;
+	}
+	if (progressive == PICTURE_SAMPLES) {
+		fprintf(stderr, "picture: frame (_FieldBased=0, no combing in %d frames)\n", read);
+		return FRAME_PICTURE;
+	}
+	if (moving < nblocks) {
+		fprintf(stderr, "picture: field (too little motion to check combing, %lld blocks)\n", (long long)moving);
+		return FIELD_PICTURE;
+	}
+	fprintf(stderr, "picture: frame (no combing in %d frames, %lld moving blocks)\n", read, (long long)moving);
+	return FRAME_PICTURE;
+}
+
+#endif
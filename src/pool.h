@@ -0,0 +1,117 @@
+// 同じ入力を開いたソースのプール（複数スレッドでのデコード用）
+// AvsSource・AuiSourceは１インスタンスを複数スレッドから使えないため、スレッドごとに別の
+// インスタンス（別のAviSynth環境、別のfunc_open()ハンドル）を貸し出す。
+// 作ったインスタンスは返却後に再利用し、最大数に達したら返却を待つ。
+#ifndef __POOL__
+#define __POOL__
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "source.h"
+
+// 複数インスタンスを同時に使う時の１インスタンスあたりのAviSynthメモリ上限（MB）
+#define POOL_MEMORY_MB 512
+
+// 同じ入力のソースを新たに開く（複数スレッドから同時に呼ばれる）
+class SourceFactory {
+public:
+	virtual ~SourceFactory() { }
+	// 画像と音声を開く（同じファイルならインスタンスを共有してよい、音声のみ使う時はvideoはNULLでよい）
+	virtual void create(Source **video, Source **audio) = 0;
+};
+
+class SourcePool {
+public:
+	// 貸し出す入力１組
+	struct Input {
+		Source *video;
+		Source *audio;
+	};
+
+private:
+	SourceFactory *_factory;
+	int _max;						// 最大インスタンス数
+	std::vector<Input*> _all;		// 作成済み
+	std::vector<Input*> _free;		// 返却済み
+	int _creating;					// 作成中の数
+	std::mutex _mutex;
+	std::condition_variable _cond;
+
+public:
+	SourcePool(SourceFactory *factory, int max) : _factory(factory), _max(max < 1 ? 1 : max), _creating(0) { }
+	~SourcePool() {
+		for (size_t k=0; k<_all.size(); k++) {
+			if (_all[k]->video) {
+				_all[k]->video->release();
+			}
+			_all[k]->audio->release();
+			delete _all[k];
+		}
+	}
+
+	// 空いている入力を借りる（無ければ作るか、返却を待つ）
+	Input *acquire() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (_free.empty() && (int)_all.size() + _creating >= _max) {
+			_cond.wait(lock);
+		}
+		if (_free.empty() == false) {
+			Input *in = _free.back();
+			_free.pop_back();
+			return in;
+		}
+		// 開くのは時間がかかるので他のスレッドを待たせない
+		_creating++;
+		lock.unlock();
+		Input *in = new Input();
+		try {
+			_factory->create(&in->video, &in->audio);
+		} catch (...) {
+			delete in;
+			// 開けなかった分は数えず、待っているスレッドに作り直させる
+			lock.lock();
+			_creating--;
+			_cond.notify_all();
+			throw;
+		}
+		lock.lock();
+		_creating--;
+		_all.push_back(in);
+		return in;
+	}
+
+	void release(Input *in) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_free.push_back(in);
+		_cond.notify_one();
+	}
+
+	int size() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return (int)_all.size();
+	}
+};
+
+// 別スレッドで起きた例外を保持し、join()後に呼び出し元のスレッドで投げ直す
+// （std::threadから例外が出るとstd::terminate()で終了してしまうため）
+class ThreadError {
+	std::mutex _mutex;
+	std::exception_ptr _error;		// 最初の例外
+public:
+	void set(std::exception_ptr e) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_error) {
+			_error = e;
+		}
+	}
+
+	void rethrow() {
+		if (_error) {
+			std::rethrow_exception(_error);
+		}
+	}
+};
+
+#endif
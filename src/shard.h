@@ -0,0 +1,135 @@
+// 時間分割での並列解析（--shards）
+// 画像・音声の読み込みと動き検索をN個の範囲に分け、範囲ごとにプールから借りたソースと別スレッドで処理する。
+//   1. 範囲ごとに全フレームの無音判定
+//   2. 無音区間を求め、動き検索が必要なフレームを列挙
+//   3. 必要なフレームを件数で均等に分け、範囲ごとに動き検索
+//   4. 前の区間の状態（lastmute_scpos/lastmute_marker）を引き継ぐ判定は１スレッドで順に処理
+// 動き検索の結果はフレームごとに決まる値なので、出力は通常の検索と一致する。
+// set_all()指定時は全フレームを動き検索し（--index）、範囲ごとに連続したフレームを読み込む。
+// スレッド内で起きた例外（ソースを開けない等）はjoin()後に呼び出し元のスレッドで投げ直す。
+#ifndef __SHARD__
+#define __SHARD__
+
+#include <vector>
+#include <thread>
+#include "source_reader.h"
+#include "chapter.h"
+#include "trace.h"
+#include "pool.h"
+
+class ShardRunner {
+	SourcePool *_pool;
+	ChapterParam _param;
+	SceneParam _sp;
+	int _n;
+	int _nshard;
+	bool _all;			// 全フレームを動き検索
+	SceneTable _scene;
+	ThreadError _error;
+
+	// [start, end)の無音判定
+	void scan_audio(int start, int end, MuteTable *table) {
+		TraceScope tr("shard_audio", "shard", start, end - start);
+		SourcePool::Input *in = NULL;
+		try {
+			in = _pool->acquire();
+			SourceMuteReader reader(in->audio, _param.setmute);
+			for (int i=start; i<end; i++) {
+				table->mute[i] = reader.is_mute(i) ? 1 : 0;
+			}
+		} catch (...) {
+			_error.set(std::current_exception());
+		}
+		if (in) {
+			_pool->release(in);
+		}
+	}
+
+	// framesの動き検索
+	void scan_video(const int *frames, int count, SceneTable *table) {
+		if (count <= 0) {
+			return;
+		}
+		TraceScope tr("shard_video", "shard", frames[0], count);
+		SourcePool::Input *in = NULL;
+		try {
+			in = _pool->acquire();
+			SourceSceneReader reader(in->video, _sp);
+			for (int k=0; k<count; k++) {
+				reader.get_scene(frames[k], &table->scene[frames[k]]);
+				table->valid[frames[k]] = 1;
+			}
+		} catch (...) {
+			_error.set(std::current_exception());
+		}
+		if (in) {
+			_pool->release(in);
+		}
+	}
+
+public:
+	ShardRunner(SourcePool *pool, const ChapterParam &param, const SceneParam &sp, int n, int nshard)
+		: _pool(pool), _param(param), _sp(sp), _n(n), _nshard(nshard < 1 ? 1 : nshard), _all(false) { }
+
+	void set_all(bool all) {
+		_all = all;
+	}
+
+	// run()で求めた動き検索結果（set_all()指定時は全フレーム）
+	const SceneTable &scene() const {
+		return _scene;
+	}
+
+	void run(SceneWriter *writer) {
+		//--- 無音判定 ---
+		MuteTable mute;
+		mute.mute.assign(_n, 0);
+		{
+			std::vector<std::thread> th;
+			for (int k=0; k<_nshard; k++) {
+				int start = (int)((int64_t)_n * k / _nshard);
+				int end = (int)((int64_t)_n * (k + 1) / _nshard);
+				th.push_back(std::thread(&ShardRunner::scan_audio, this, start, end, &mute));
+			}
+			for (size_t k=0; k<th.size(); k++) {
+				th[k].join();
+			}
+			_error.rethrow();
+		}
+
+		//--- 動き検索が必要なフレーム ---
+		std::vector<int> frames;
+		if (_all) {
+			for (int i=0; i<_n; i++) {
+				frames.push_back(i);
+			}
+		} else {
+			list_scene_frames(&mute, _param, _n, &frames);
+		}
+
+		//--- 動き検索 ---
+		SceneTable &scene = _scene;
+		scene.scene.resize(_n);
+		scene.valid.assign(_n, 0);
+		{
+			std::vector<std::thread> th;
+			int count = (int)frames.size();
+			for (int k=0; k<_nshard; k++) {
+				int start = (int)((int64_t)count * k / _nshard);
+				int end = (int)((int64_t)count * (k + 1) / _nshard);
+				if (start < end) {
+					th.push_back(std::thread(&ShardRunner::scan_video, this, &frames[start], end - start, &scene));
+				}
+			}
+			for (size_t k=0; k<th.size(); k++) {
+				th[k].join();
+			}
+			_error.rethrow();
+		}
+
+		//--- 判定・出力 ---
+		search_chapter(&mute, &scene, writer, _param, _n, -1);
+	}
+};
+
+#endif
@@ -14,13 +14,20 @@
   #define FreeLibrary dlclose
 #endif
 #include <string>
+#include <vector>
+#include <mutex>
 #include <algorithm>
 #include <cstdio>
 #include <string.h>
 #include "input.h"
+#include "stats.h"
+#include "border.h"
 
 using namespace std;
 
+// read_audio()のバッファの大きさ（short単位、10fps以上・8chの32bitまで）
+#define AUDIO_BUF_SIZE (4800*8*2)
+
 class Source {
 public:
 	virtual int add_ref() = 0;
@@ -34,7 +41,13 @@ public:
 	virtual void set_rate(int rate, int scale) = 0;
 
 	virtual bool read_video_y8(int frame, unsigned char *luma) = 0;
+	// audio_formatの形式のまま読み込む（16bit以外もあり）、戻り値はサンプル数
 	virtual int read_audio(int frame, short *buf) = 0;
+	// フレームプロパティ_FieldBasedの値（0:フレーム 1:BFF 2:TFF、ない時は-1）
+	virtual int field_based(int frame) = 0;
+
+	// 追記中のファイルを読み直し、読み込み可能なフレーム数を返す
+	virtual int refresh() = 0;
 };
 
 // 空のソース
@@ -58,10 +71,48 @@ public:
 		_ip.scale = scale;
 	}
 
+	// 読み込み可能なフレーム数（画像・音声の短い方）
+	int frames_available() {
+		int n = has_video() ? _ip.n : INT_MAX;
+		if (has_audio() && _ip.audio_n >= 0 && _ip.rate > 0 && _ip.audio_format->nSamplesPerSec > 0) {
+			int64_t na = (int64_t)_ip.audio_n * _ip.rate / ((int64_t)_ip.audio_format->nSamplesPerSec * _ip.scale);
+			n = (int)min((int64_t)n, na);
+		}
+		return n;
+	}
+
+	int refresh() { return frames_available(); }
+
 	// must implement
 	void init(char *infile) { };
 	bool read_video_y8(int frame, unsigned char *luma) { return false; };
 	int read_audio(int frame, short *buf) { return 0; };
+	int field_based(int frame) { return -1; };
+};
+
+// 読み込み済みの先頭フレームの音声（FAWの確認で読んだ分を本処理で読み直さない）
+class AudioFrameCache {
+	std::vector<std::vector<short> > _data;
+	std::vector<int> _naudio;
+public:
+	// 次のフレームの音声を保存（bytesはbufの有効なバイト数）
+	void add(const short *buf, int naudio, int bytes) {
+		_data.push_back(std::vector<short>(buf, buf + (bytes + 1) / 2));
+		_naudio.push_back(naudio);
+	}
+
+	// 保存してあればbufに写してtrue
+	bool read(int frame, short *buf, int *naudio) const {
+		if (frame < 0 || frame >= (int)_naudio.size()) {
+			return false;
+		}
+		const std::vector<short> &d = _data[frame];
+		if (d.empty() == false) {
+			memcpy(buf, &d[0], d.size() * sizeof(short));
+		}
+		*naudio = _naudio[frame];
+		return true;
+	}
 };
 
 #ifdef _WIN32
@@ -217,18 +268,26 @@ public:
 			int size = 0;
 			fread(&size, 4, 1, _f);
 			if (strncmp(buf, "fmt ", 4) == 0) {
-				if (fread(&_fmt, min(size, (int)sizeof(_fmt)), 1, _f) != 1) {
+				// WAVEFORMATEXTENSIBLEはSubFormat（先頭2バイトが形式）まで読む
+				unsigned char ext[40] = {0};
+				int len = min(size, (int)sizeof(ext));
+				if (len < 16 || fread(ext, len, 1, _f) != 1) {
 					throw "   illegal WAVE file.";
 				}
-				if (_fmt.wFormatTag != WAVE_FORMAT_PCM) {
-					throw "   only PCM supported.";
+				memcpy(&_fmt, ext, sizeof(_fmt));
+				if (_fmt.wFormatTag == WAVE_FORMAT_EXTENSIBLE && len >= 26) {
+					memcpy(&_fmt.wFormatTag, ext + 24, 2);
 				}
-				int diff = size - sizeof(_fmt);
-				if (diff > 0) {
-					fseek(_f, size - sizeof(_fmt), SEEK_CUR);
+				bool pcm = (_fmt.wFormatTag == WAVE_FORMAT_PCM) &&
+					(_fmt.wBitsPerSample == 16 || _fmt.wBitsPerSample == 24 || _fmt.wBitsPerSample == 32);
+				bool flt = (_fmt.wFormatTag == WAVE_FORMAT_IEEE_FLOAT) && (_fmt.wBitsPerSample == 32);
+				if (!pcm && !flt) {
+					throw "   only 16/24/32bit PCM or 32bit float supported.";
+				}
+				if (size > len) {
+					fseek(_f, size - len, SEEK_CUR);
 				}
 			} else if (strncmp(buf, "data", 4) == 0){
-				fseek(_f, 4, SEEK_CUR);
 #ifdef _WIN32
 				_start = _ftelli64(_f);
 #else
@@ -263,6 +322,19 @@ public:
 
 		return fread(buf, _fmt.nBlockAlign, (size_t)(end - start), _f);
 	}
+
+	// ファイルサイズからサンプル数を更新（書き込み中はヘッダのサイズが未確定のため）
+	int refresh() {
+#ifdef _WIN32
+		_fseeki64(_f, 0, SEEK_END);
+		int64_t size = _ftelli64(_f);
+#else
+		fseeko(_f, 0, SEEK_END);
+		int64_t size = ftello(_f);
+#endif
+		_ip.audio_n = (int)min((int64_t)INT_MAX, (size - _start) / _fmt.nBlockAlign);
+		return frames_available();
+	}
 };
 
 
@@ -270,13 +342,106 @@ public:
 #include <avisynth.h>
 #include <stdio.h>
 #include <dlfcn.h>
+#include <emmintrin.h>
 
 const AVS_Linkage *AVS_linkage = nullptr;
 
+// 16bit格納の輝度（有効bitsビット）１行分を8bitに変換（四捨五入、ディザなし）
+// 画素のコピーと同時に行い、フレームサーバー側での全画面の変換を省く
+inline void luma16_to_8(unsigned char *dst, const uint16_t *src, int w, int bits) {
+  int shift = bits - 8;
+  int j = 0;
+  __m128i round = _mm_set1_epi16((short)(1 << (shift - 1)));
+  __m128i count = _mm_cvtsi32_si128(shift);
+  for (; j + 16 <= w; j += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + j));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + j + 8));
+    a = _mm_srl_epi16(_mm_adds_epu16(a, round), count);
+    b = _mm_srl_epi16(_mm_adds_epu16(b, round), count);
+    _mm_storeu_si128((__m128i*)(dst + j), _mm_packus_epi16(a, b));
+  }
+  for (; j < w; j++) {
+    int v = (min(src[j] + (1 << (shift - 1)), 65535)) >> shift;
+    dst[j] = (unsigned char)min(v, 255);
+  }
+}
+
+// AviSynthの読み込み設定
+struct AvsOption {
+  int memory_max;   // 環境のメモリ上限（MB、0なら既定値）
+  int threads;      // Prefetchのスレッド数（0なら使わない）
+  bool luma_only;   // ConvertToYで輝度のみにする
+  bool crop_auto;   // 黒帯を検出してCropする
+  int crop[4];      // Crop（左・上・右・下）
+  bool audio_only;  // 音声のみ使う（画像なしも可、画像の確認・変換をしない）
+  AvsOption() : memory_max(0), threads(0), luma_only(false), crop_auto(false), audio_only(false) {
+    crop[0] = crop[1] = crop[2] = crop[3] = 0;
+  }
+};
+
+// AviSynthのライブラリと環境（参照カウントで共有）
+// 画像と音声が別のスクリプトでも同じ環境で読み込み、プラグインの読み込みやキャッシュを１つで済ませる
+// SourcePoolでは複数スレッドから同時に作られるので、ライブラリの読み込み・環境の作成と破棄、
+// AVS_linkage（プロセスで１つ）の設定は１スレッドずつ行う
+class AvsEnv {
+  void *_handle;
+  int _ref;
+  ~AvsEnv() {
+    std::lock_guard<std::mutex> lock(mutex());
+    if (env) env->DeleteScriptEnvironment();
+    if (_handle) dlclose(_handle);
+  }
+  static std::mutex &mutex() {
+    static std::mutex m;
+    return m;
+  }
+public:
+  IScriptEnvironment *env;
+
+  AvsEnv() : _handle(NULL), _ref(1), env(NULL) { }
+
+  // ライブラリを読み込んで環境を作る（memory_maxはメモリ上限MB、0なら既定値）
+  void create(int memory_max) {
+    std::lock_guard<std::mutex> lock(mutex());
+    _handle = dlopen("libavisynth.so", RTLD_LAZY);
+    if (_handle == NULL) {
+      throw "Cannot load libavisynth.so";
+    }
+
+    typedef IScriptEnvironment * (* func_t)(int);
+    void *mkr = dlsym(_handle, "CreateScriptEnvironment");
+    if(mkr == NULL) {
+      throw "Cannot find CreateScriptEnvironment";
+    }
+
+    func_t CreateScriptEnvironment = (func_t)mkr;
+    env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+    if (env == NULL) {
+      throw "CreateScriptEnvironment failed";
+    }
+
+    // 最初の環境で１回だけ設定（ライブラリを開いている間は同じ値）
+    if (AVS_linkage == nullptr) {
+      AVS_linkage = env->GetAVSLinkage(); // e.g. for VideoInfo.BitsPerComponent, etc..
+    }
+    if (memory_max > 0) {
+      env->SetMemoryMax(memory_max);
+    }
+  }
+
+  int add_ref() { return ++_ref; }
+  int release() { int r = --_ref; if (r <= 0) delete this; return r; }
+};
+
 class AvsSource : public NullSource {
 protected:
+  string _in;
   VideoInfo inf;
+  AvsEnv *_env;     // 共有する環境
   IScriptEnvironment *env;
+  AvsOption _opt;
+  bool _crop_detected;  // 黒帯の検出済み（refresh()では同じ値を使う）
+  int _bits;            // 輝度のビット数（8〜16、9以上は16bitで格納）
   PClip clip;
   BITMAPINFOHEADER format;
   WAVEFORMATEX audio_format;
@@ -284,85 +449,209 @@ protected:
 public:
   AvsSource(void) 
     : NullSource()
+    , _env(NULL)
+    , env(NULL)
+    , _crop_detected(false)
+    , _bits(8)
     , format()
     , audio_format()
   {}
+  virtual ~AvsSource() {
+    // 環境より先にクリップを解放
+    clip = PClip();
+    if (_env) _env->release();
+  }
 
-  virtual void init(const char *infile) {
-    int interlaced = 0;
-    int tff = 0;
-    if (env) env->DeleteScriptEnvironment();
-  
-    void *handle = dlopen("libavisynth.so", RTLD_LAZY);
-    if (handle == NULL) {
-      fprintf(stdout, "Cannot load libavisynth.so\r\n");
-    }
-  
-    typedef IScriptEnvironment * (* func_t)(int);
-    void *mkr = dlsym(handle, "CreateScriptEnvironment");
-    if(mkr == NULL) {
-      fprintf(stdout, "Cannot find CreateScriptEnvironment\r\n");
+  AvsEnv *get_env() {
+    return _env;
+  }
+
+  // 他のソースの環境を使う（init()の前に設定、メモリ上限は共有元の設定になる）
+  void share_env(AvsEnv *e) {
+    if (e) e->add_ref();
+    if (_env) _env->release();
+    _env = e;
+    env = e ? e->env : NULL;
+  }
+
+  // 読み込み設定（init()の前に設定）
+  //   memory_max : 同時に複数の環境を作る時などに使う
+  //   threads    : 検索は前から順にフレームを要求するので、Prefetchの先読み範囲とそのまま一致する
+  //   luma_only・crop : 輝度のみ・必要な範囲のみをフレームサーバー側で作らせ、色差や黒帯の処理を省く
+  void set_option(const AvsOption &opt) {
+    _opt = opt;
+    if (env && opt.memory_max > 0) {
+      env->SetMemoryMax(opt.memory_max);
     }
-  
-    func_t CreateScriptEnvironment = (func_t)mkr;
-    env = CreateScriptEnvironment(AVISYNTH_INTERFACE_VERSION);
+  }
 
-    AVS_linkage = env->GetAVSLinkage(); // e.g. for VideoInfo.BitsPerComponent, etc..
+  // 使用中の切り取り範囲（検出済みの値を他のインスタンスに渡す）
+  void get_crop(AvsOption *opt) {
+    memcpy(opt->crop, _opt.crop, sizeof(opt->crop));
+    opt->crop_auto = false;
+  }
 
-    try {
-      AVSValue arg = infile;
-      AVSValue res = env->Invoke("Import", arg);
-      int mt_mode = res.IsInt() ? res.AsInt() : 0;
-      if( mt_mode > 0 && mt_mode < 5 ) {
-        AVSValue temp = env->Invoke("Distributor", res);
-        // need release old res
-        res = temp;
-      }
-      if(!res.IsClip()){
-        throw "error: inputfile didn't return a video clip";
+  // 先頭から末尾まで均等にフレームを取り出し、上下左右の黒帯の幅を求める
+  void detect_border(PClip c, const VideoInfo &vi, int *crop) {
+    int w = vi.width;
+    int h = vi.height;
+    std::vector<int> row(h, 0), col(w, 0);
+    for (int k=0; k<BORDER_SAMPLES; k++) {
+      int frame = (int)((int64_t)vi.num_frames * (k + 1) / (BORDER_SAMPLES + 1));
+      PVideoFrame f = c->GetFrame(frame, env);
+      const unsigned char *data = f->GetReadPtr(PLANAR_Y);
+      if (data == NULL) {
+        continue;
       }
-  
-      clip = res.AsClip();
-      inf = clip->GetVideoInfo();
-  
-      
-      if(!inf.HasVideo()){
-        throw "error: inputfile has no video data";
-      }
-      /* if the clip is made of fields instead of frames, call weave to make them frames */
-      if(inf.IsFieldBased()){
-      	fprintf(stderr, "detected fieldbased (separated) input, weaving to frames\n");
-        throw "error: couldn't weave fields into frames";
-        //AVSValue tmp = env->Invoke("Weave", res);
-        // need release old res
-        //res = tmp;
-        //interlaced = 1;
-        //tff = inf.IsTFF();
+      int pitch = f->GetPitch(PLANAR_Y);
+      if (vi.ComponentSize() == 2) {
+        std::vector<unsigned char> luma(w * h);
+        for (int i=0; i<h; i++) {
+          luma16_to_8(&luma[i * w], (const uint16_t*)(data + pitch*i), w, vi.BitsPerComponent());
+        }
+        border_accumulate(&row[0], &col[0], &luma[0], w, w, h);
+      } else {
+        border_accumulate(&row[0], &col[0], data, pitch, w, h);
       }
-      
-      if(inf.IsPlanar()==false){
-        fprintf(stderr, "converting input clip to Y420\n");
-        //char *arg_name[2] = {NULL, "interlaced"};
-        //AVSValue arg_arr[2] = {res, bool(interlaced)};
-        //AVSValue tmp = env->Invoke("ConvertToY420", (arg_arr, 2), arg_name);
-        throw "error: input file isn't Y420";
-      }
-  
-      if(inf.num_audio_samples > 0 && inf.BytesPerChannelSample() !=2){
-        AVSValue tmp = env->Invoke("ConvertAudioTo16bit", res);
-        res = tmp;
-      	clip = res.AsClip();
-      	inf = clip->GetVideoInfo();
+    }
+    border_find(&row[0], &col[0], w, h, crop);
+    // 色差があっても切れるよう偶数に切り上げ
+    for (int k=0; k<4; k++) {
+      crop[k] = (crop[k] + 1) & ~1;
+    }
+    fprintf(stderr, "detected border: left %d top %d right %d bottom %d\n", crop[0], crop[1], crop[2], crop[3]);
+  }
+
+  // スクリプトを読み込み、処理できる形式に変換したクリップを返す
+  PClip import(const char *infile) {
+    AVSValue arg = infile;
+    AVSValue res = env->Invoke("Import", arg);
+    int mt_mode = res.IsInt() ? res.AsInt() : 0;
+    bool distributed = false;
+    if( mt_mode > 0 && mt_mode < 5 ) {
+      AVSValue temp = env->Invoke("Distributor", res);
+      // need release old res
+      res = temp;
+      distributed = true;
+    }
+    if(!res.IsClip()){
+      throw "error: inputfile didn't return a video clip";
+    }
+
+    PClip c = res.AsClip();
+    VideoInfo vi = c->GetVideoInfo();
+
+    // 24bit・32bit・浮動小数点はそのまま読み込んで判定する（8bitのみ16bitに変換）
+    if(vi.num_audio_samples > 0 && vi.SampleType() == SAMPLE_INT8){
+      AVSValue tmp = env->Invoke("ConvertAudioTo16bit", res);
+      res = tmp;
+    	c = res.AsClip();
+    	vi = c->GetVideoInfo();
 	fprintf(stderr, "converting input clip to 16bit audio\n");
+    }
+
+    // 音声のみ使う時は画像の確認・変換をしない
+    if (_opt.audio_only) {
+      return c;
+    }
+
+    if(!vi.HasVideo()){
+      throw "error: inputfile has no video data";
+    }
+    /* if the clip is made of fields instead of frames, call weave to make them frames */
+    if(vi.IsFieldBased()){
+    	fprintf(stderr, "detected fieldbased (separated) input, weaving to frames\n");
+      throw "error: couldn't weave fields into frames";
+      //AVSValue tmp = env->Invoke("Weave", res);
+      // need release old res
+      //res = tmp;
+      //interlaced = 1;
+      //tff = vi.IsTFF();
+    }
+    
+    // 10〜16bitはそのまま読み込み、輝度のコピー時に8bitにする（ConvertBits(8)は不要）
+    if(vi.ComponentSize() > 2){
+      throw "error: float video isn't supported";
+    }
+
+    if(vi.IsPlanar()==false){
+      fprintf(stderr, "converting input clip to Y420\n");
+      //char *arg_name[2] = {NULL, "interlaced"};
+      //AVSValue arg_arr[2] = {res, bool(interlaced)};
+      //AVSValue tmp = env->Invoke("ConvertToY420", (arg_arr, 2), arg_name);
+      throw "error: input file isn't Y420";
+    }
+
+    // 輝度のみに変換（色差を作らない）
+    if (_opt.luma_only && vi.IsY() == false) {
+      const char *func = env->FunctionExists("ConvertToY") ? "ConvertToY" : "ConvertToY8";
+      AVSValue tmp = env->Invoke(func, res);
+      res = tmp;
+      c = res.AsClip();
+      vi = c->GetVideoInfo();
+    }
+
+    // 黒帯を切り取る（検出は最初の読み込み時のみ）
+    if (_opt.crop_auto && _crop_detected == false) {
+      detect_border(c, vi, _opt.crop);
+      _crop_detected = true;
+    }
+    if (_opt.crop[0] > 0 || _opt.crop[1] > 0 || _opt.crop[2] > 0 || _opt.crop[3] > 0) {
+      AVSValue args[5] = { c, _opt.crop[0], _opt.crop[1], -_opt.crop[2], -_opt.crop[3] };
+      AVSValue tmp = env->Invoke("Crop", AVSValue(args, 5));
+      res = tmp;
+      c = res.AsClip();
+      vi = c->GetVideoInfo();
+    }
+
+    // スクリプト側でMT化していなければ変換後のクリップを先読み
+    if (_opt.threads > 0 && distributed == false) {
+      if (env->FunctionExists("Prefetch")) {
+        AVSValue args[2] = { c, _opt.threads };
+        AVSValue tmp = env->Invoke("Prefetch", AVSValue(args, 2));
+        res = tmp;
+        c = res.AsClip();
+      } else {
+        fprintf(stderr, "Prefetch is not available (not AviSynth+ MT), ignored\n");
+      }
+    }
+    return c;
+  }
+
+  virtual void init(const char *infile) {
+    int interlaced = 0;
+    int tff = 0;
+    if (_env == NULL) {
+      AvsEnv *e = new AvsEnv();
+      try {
+        e->create(_opt.memory_max);
+      } catch (const char *) {
+        e->release();
+        throw;
       }
+      _env = e;
+      env = e->env;
+    }
+
+    _in = infile;
+    try {
+      clip = import(infile);
+      inf = clip->GetVideoInfo();
     }
     catch (const AvisynthError &err) {
       fprintf(stdout,"Avisynth ERROR: %s\r\n", err.msg);
     }
-    _ip.flag = INPUT_INFO_FLAG_VIDEO_RANDOM_ACCESS | INPUT_INFO_FLAG_VIDEO;
+    _ip.flag = 0;
+    if (inf.HasVideo()) {
+        _ip.flag |= INPUT_INFO_FLAG_VIDEO_RANDOM_ACCESS | INPUT_INFO_FLAG_VIDEO;
+    }
     if (inf.num_audio_samples > 0) {
         _ip.flag |= INPUT_INFO_FLAG_AUDIO;
     }
+    _bits = (inf.ComponentSize() == 2) ? inf.BitsPerComponent() : 8;
+    if (_bits > 8) {
+      fprintf(stderr, "%d bit luma\n", _bits);
+    }
     _ip.rate = inf.fps_numerator;
     _ip.scale = inf.fps_denominator;
     _ip.n = inf.num_frames;
@@ -374,12 +663,19 @@ public:
     _ip.audio_format = &audio_format;
     audio_format.nChannels = inf.nchannels;
     audio_format.nSamplesPerSec = inf.audio_samples_per_second;
+    set_audio_format();
+  }
 
-    //env_->DeleteScriptEnvironment();
-    //fprintf(stdout,"Avisynth Script Environment deleted\r\n");
-    
-    //dlclose(handle);
-    //fprintf(stdout,"Ready to exit\r\n");
+  // 音声サンプルの形式
+  void set_audio_format() {
+    int type = inf.SampleType();
+    audio_format.wFormatTag = (type == SAMPLE_FLOAT) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+    audio_format.wBitsPerSample = (type == SAMPLE_INT24) ? 24 : (type == SAMPLE_INT32 || type == SAMPLE_FLOAT) ? 32 : 16;
+    audio_format.nBlockAlign = audio_format.wBitsPerSample / 8 * audio_format.nChannels;
+    audio_format.nAvgBytesPerSec = audio_format.nBlockAlign * audio_format.nSamplesPerSec;
+    if (inf.num_audio_samples > 0 && audio_format.wBitsPerSample != 16) {
+      fprintf(stderr, "%s audio\n", (type == SAMPLE_FLOAT) ? "float" : (type == SAMPLE_INT24) ? "24bit" : "32bit");
+    }
   }
 
   bool has_video() {
@@ -393,6 +689,35 @@ public:
     return _ip;
   }
 
+  // スクリプトを読み直し、フレーム数かサンプル数が増えていればクリップを差し替える
+  int refresh() {
+    try {
+      PClip c = import(_in.c_str());
+      VideoInfo vi = c->GetVideoInfo();
+      if (vi.num_frames > inf.num_frames || vi.num_audio_samples > inf.num_audio_samples) {
+        clip = c;
+        inf = vi;
+        if (inf.num_audio_samples > 0) {
+          _ip.flag |= INPUT_INFO_FLAG_AUDIO;
+        }
+        _ip.n = inf.num_frames;
+        _ip.audio_n = (int)min((int64_t)INT_MAX, inf.num_audio_samples);
+      }
+    }
+    catch (const AvisynthError &err) {
+      fprintf(stdout,"Avisynth ERROR: %s\r\n", err.msg);
+    }
+    catch (const char *s) {
+      fprintf(stdout,"%s\r\n", s);
+    }
+    int n = has_video() ? _ip.n : INT_MAX;
+    if (has_audio() && _ip.rate > 0 && inf.audio_samples_per_second > 0) {
+      int64_t na = inf.num_audio_samples * _ip.rate / ((int64_t)inf.audio_samples_per_second * _ip.scale);
+      n = (int)min((int64_t)n, na);
+    }
+    return n;
+  }
+
   bool read_video_y8(int frame, unsigned char *luma) {
     PVideoFrame f = clip->GetFrame(frame,env); 
     static const int planes[] = {PLANAR_Y, PLANAR_U, PLANAR_V};
@@ -404,6 +729,13 @@ public:
 
     //avs_h.func.avs_bit_blt(avs_h.env, luma, w, data, pitch, w, h);
     //env->BitBlt(luma, w, data, pitch, w, h);
+    StatScope st(ST_LUMA);
+    if (_bits > 8) {
+      for (int i=0; i<h; i++) {
+        luma16_to_8(luma + w*i, (const uint16_t*)(data + pitch*i), w, _bits);
+      }
+      return true;
+    }
     for (int i=0; i<h; i++) {
       const unsigned char* p = data + pitch*i;
 			for (int j=0; j<w; j++) {
@@ -416,6 +748,17 @@ public:
     return true;
   }
 
+  // フレームプロパティはAviSynth+（propGetIntのある版）のみ
+  int field_based(int frame) {
+    if (env->FunctionExists("propGetInt") == false) {
+      return -1;
+    }
+    PVideoFrame f = clip->GetFrame(frame, env);
+    int error = 0;
+    int64_t v = env->propGetInt(env->getFramePropsRO(f), "_FieldBased", 0, &error);
+    return error ? -1 : (int)v;
+  }
+
   int read_audio(int frame, short *buf) {
     int64_t start = (int64_t)((double)frame * _ip.audio_format->nSamplesPerSec / _ip.rate * _ip.scale);
 		int64_t end = (int64_t)((double)(frame + 1) * _ip.audio_format->nSamplesPerSec / _ip.rate * _ip.scale);
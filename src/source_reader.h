@@ -0,0 +1,183 @@
+// Sourceから無音判定・動き検索結果を取得（CLI用）
+#ifndef __SOURCE_READER__
+#define __SOURCE_READER__
+
+#include "source.h"
+#include "chapter.h"
+#include "stats.h"
+#include "trace.h"
+#include "border.h"
+
+#ifndef _WIN32
+#include <malloc.h>
+#define _aligned_malloc(a,b) memalign(b,a)
+#define _aligned_free free
+#endif
+
+// 画像読み込み（--stats集計・--trace記録付き）
+inline bool read_video(Source *video, int frame, unsigned char *luma) {
+	StatScope st(ST_VIDEO);
+	TraceScope tr("read_video_y8", "video", frame);
+	if (g_stats) g_stats->add_frame(frame);
+	return video->read_video_y8(frame, luma);
+}
+// 音声読み込み（--stats集計・--trace記録付き）
+inline int read_audio(Source *audio, int frame, short *buf) {
+	TraceScope tr("read_audio", "audio", frame);
+	int naudio = audio->read_audio(frame, buf);
+	if (g_stats) g_stats->add_audio(frame, naudio);
+	return naudio;
+}
+
+// 音声ソースのサンプル形式（AUDIO_S16など）
+inline int audio_sample_type(Source *audio) {
+	const WAVEFORMATEX *fmt = audio->get_input_info().audio_format;
+	if (fmt == NULL) {
+		return AUDIO_S16;
+	}
+	if (fmt->wFormatTag == WAVE_FORMAT_IEEE_FLOAT && fmt->wBitsPerSample == 32) {
+		return AUDIO_FLOAT;
+	}
+	if (fmt->wBitsPerSample == 24) {
+		return AUDIO_S24;
+	}
+	if (fmt->wBitsPerSample == 32) {
+		return AUDIO_S32;
+	}
+	return AUDIO_S16;
+}
+
+// 音声ソースから無音判定
+class SourceMuteReader : public MuteReader {
+	Source *_audio;
+	int _mute;
+	int _type;
+	const AudioFrameCache *_cache;
+	short _buf[AUDIO_BUF_SIZE];
+public:
+	SourceMuteReader(Source *audio, int mute) : _audio(audio), _mute(mute), _type(audio_sample_type(audio)), _cache(NULL) { }
+
+	// 読み込み済みのフレーム（_audioから読んだもの）
+	void set_cache(const AudioFrameCache *cache) {
+		_cache = cache;
+	}
+
+	bool is_mute(int frame) {
+		StatScope st(ST_AUDIO);
+		int naudio;
+		if (_cache == NULL || _cache->read(frame, _buf, &naudio) == false) {
+			naudio = read_audio(_audio, frame, _buf);
+		}
+		return audio_is_mute(_buf, naudio, _mute, _type);
+	}
+};
+
+// 画像ソースから動き検索
+// 直前に読み込んだフレームを保持し、連続したフレームの読み込みは１回で済ませる
+// --roi指定時は最初に黒帯を検出し、前後フレームとも黒帯部分が暗い時だけ黒帯のブロックを検索しない
+// （フレームの内容だけで決まるので、どの順で読み込んでも結果は同じ）
+// --coarse指定時はbreakmuteより長い無音区間で、直前の２フレームと全く同じフレームが続く間は
+// 同じ画像の組を比べた前回の結果を使い、動き検索しない（mvec()は画像だけで決まるので結果は通常と同じ）
+class SourceSceneReader : public SceneReader {
+	Source *_video;
+	int _w, _h;
+	unsigned char *_pix0;		// 前フレーム
+	unsigned char *_pix1;		// 現フレーム
+	int _last;					// _pix0のフレーム番号
+	bool _use_roi;				// 黒帯を検出した
+	MvecRoi _roi;
+	bool _dark0;				// _pix0の黒帯部分が暗い
+	int _pict;					// FRAME_PICTURE/FIELD_PICTURE
+	bool _coarse;				// 同じ画像の組は前回の結果を使う
+	int _coarse_end;			// 前回の結果を使ってよい最後のフレーム
+	bool _still;				// _still_siが_pix0と同じ画像の組を比べた結果
+	SceneInfo _still_si;
+
+	bool is_dark(const unsigned char *luma) {
+		return border_is_dark(luma, _w, _w, _h, _roi.x0, _roi.y0, _roi.x1, _roi.y1);
+	}
+
+	// 全体から均等に取り出したフレームで黒帯を検出
+	void detect_roi() {
+		INPUT_INFO &vii = _video->get_input_info();
+		std::vector<int> row(_h, 0), col(_w, 0);
+		for (int k=0; k<BORDER_SAMPLES; k++) {
+			int frame = (int)((int64_t)vii.n * (k + 1) / (BORDER_SAMPLES + 1));
+			if (read_video(_video, frame, _pix1)) {
+				border_accumulate(&row[0], &col[0], _pix1, _w, _w, _h);
+			}
+		}
+		int border[4];
+		border_find(&row[0], &col[0], _w, _h, border);
+		_roi.x0 = border[0];
+		_roi.y0 = border[1];
+		_roi.x1 = _w - border[2];
+		_roi.y1 = _h - border[3];
+		// ブロック単位で外れる部分がなければ使わない
+		_use_roi = (_roi.x0 >= 16 || _roi.y0 >= 16 || _roi.x1 <= _w - 16 || _roi.y1 <= _h - 16);
+		if (_use_roi) {
+			fprintf(stderr, "roi: %d,%d - %d,%d\n", _roi.x0, _roi.y0, _roi.x1, _roi.y1);
+		}
+	}
+
+public:
+	SourceSceneReader(Source *video, const SceneParam &sp = SceneParam()) : _video(video), _last(-1), _use_roi(false), _dark0(false),
+		_pict(sp.picture == FRAME_PICTURE ? FRAME_PICTURE : FIELD_PICTURE), _coarse(sp.coarse > 0), _coarse_end(-1), _still(false)
+	{
+		INPUT_INFO &vii = video->get_input_info();
+		_w = vii.format->biWidth & 0xFFFFFFF0;
+		_h = vii.format->biHeight & 0xFFFFFFF0;
+		_pix0 = (unsigned char*)_aligned_malloc(_w * _h, 32);
+		_pix1 = (unsigned char*)_aligned_malloc(_w * _h, 32);
+		if (sp.roi && sp.roi_found != 0) {
+			_use_roi = (sp.roi_found > 0);
+			_roi = sp.roi_area;
+		} else if (sp.roi) {
+			detect_roi();
+		}
+	}
+	~SourceSceneReader() {
+		_aligned_free(_pix0);
+		_aligned_free(_pix1);
+	}
+
+	// 検出した黒帯を設定に入れる（同じソースを開く他の読み込みでは検出し直さない）
+	void get_roi(SceneParam *sp) {
+		if (sp->roi) {
+			sp->roi_found = _use_roi ? 1 : -1;
+			sp->roi_area = _roi;
+		}
+	}
+
+	void set_range(int start, int end, bool long_mute) {
+		_coarse_end = (_coarse && long_mute) ? end : -1;
+	}
+
+	bool get_scene(int frame, SceneInfo *si) {
+		int bef = (frame > 0) ? frame - 1 : 0;
+		if (_last != bef) {
+			read_video(_video, bef, _pix0);
+			_dark0 = _use_roi && is_dark(_pix0);
+			_still = false;
+		}
+		bool ret = read_video(_video, frame, _pix1);
+		bool same = (frame <= _coarse_end && memcmp(_pix0, _pix1, _w * _h) == 0);
+		if (same && _still) {
+			// 前回と同じ画像の組
+			*si = _still_si;
+		} else {
+			bool dark1 = _use_roi && is_dark(_pix1);
+			measure_scene(si, _pix1, _pix0, _w, _h, frame, (_dark0 && dark1) ? &_roi : NULL, _pict);
+			_dark0 = dark1;
+			_still_si = *si;
+			_still = same;
+		}
+		unsigned char *tmp = _pix0;
+		_pix0 = _pix1;
+		_pix1 = tmp;
+		_last = frame;
+		return ret;
+	}
+};
+
+#endif
@@ -0,0 +1,257 @@
+// 処理時間・処理回数の集計（--stats）
+#ifndef __STATS__
+#define __STATS__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include "mvec.h"
+
+// 計測する処理
+enum {
+	ST_AUDIO = 0,		// 音声読み込み＋無音判定
+	ST_VIDEO,			// 画像読み込み（デコード＋輝度コピー）
+	ST_LUMA,			// 輝度コピー（ST_VIDEOの内数）
+	ST_MVEC,			// 動き検索
+	ST_OUTPUT,			// 結果出力
+	ST_NUM
+};
+
+// 時間取得
+inline double stat_clock(clockid_t id) {
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// JSON文字列用のエスケープ
+inline std::string stat_escape(const char *s) {
+	std::string r;
+	for (; s && *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			r += '\\';
+			r += *s;
+		} else if ((unsigned char)*s < 0x20) {
+			char tmp[8];
+			sprintf(tmp, "\\u%04x", *s);
+			r += tmp;
+		} else {
+			r += *s;
+		}
+	}
+	return r;
+}
+
+class ChapterStats {
+	struct Phase {
+		double wall;
+		double cpu;
+		int64_t calls;
+	};
+	struct Interval {
+		int idx;			// 無音区間通算番号
+		int start_fr;		// 開始フレーム
+		int seri;			// 無音フレーム数
+		int64_t decoded;	// 区間で使うフレームを読み込んだ回数（読み込んだ時期は問わない）
+		double wall;		// 区間処理時間
+	};
+
+	std::string _path;
+	Phase _phase[ST_NUM];
+	std::vector<unsigned char> _decoded;	// フレームごとの読み込み回数（255まで）
+	std::vector<Interval> _intervals;
+	double _wall_start;
+	double _cpu_start;
+	double _last_write;
+	double _periodic;				// 途中経過の出力間隔（秒、0は出力しない）
+	int _pos;						// 読み込んだ最後のフレーム（途中経過の位置）
+	int64_t _frames_decoded;
+	int64_t _audio_reads;
+	int64_t _audio_samples;
+
+	// 区間処理中の値
+	double _interval_wall;
+
+	std::mutex _lock;				// 並列処理（--shards）時の集計用
+
+	// 途中経過の出力（前回出力から指定秒数経過時のみ、_lockを取って呼ぶ）
+	// 読み込みごとに確認するので、無音のない長い部分や並列処理中も出力する
+	void periodic() {
+		if (_periodic > 0 && stat_clock(CLOCK_MONOTONIC) - _last_write >= _periodic) {
+			write_locked(false, _pos);
+		}
+	}
+
+	// JSON出力（_lockを取って呼ぶ）
+	bool write_locked(bool final, int pos) {
+		_last_write = stat_clock(CLOCK_MONOTONIC);
+		FILE *f = fopen(_path.c_str(), "w");
+		if (f == NULL) {
+			return false;
+		}
+		int64_t unique = 0, again = 0;
+		for (size_t i=0; i<_decoded.size(); i++) {
+			if (_decoded[i] > 0) unique++;
+			if (_decoded[i] > 1) again++;
+		}
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+
+		fprintf(f, "{\n");
+		fprintf(f, "  \"final\": %s,\n", final ? "true" : "false");
+		fprintf(f, "  \"position\": %d,\n", pos);
+		fprintf(f, "  \"video\": \"%s\",\n", stat_escape(video.c_str()).c_str());
+		fprintf(f, "  \"audio\": \"%s\",\n", stat_escape(audio.c_str()).c_str());
+		fprintf(f, "  \"frames\": %d,\n", frames);
+		fprintf(f, "  \"fps\": %.3f,\n", fps);
+		fprintf(f, "  \"wall\": %.6f,\n", _last_write - _wall_start);
+		fprintf(f, "  \"cpu\": %.6f,\n", stat_clock(CLOCK_PROCESS_CPUTIME_ID) - _cpu_start);
+		fprintf(f, "  \"phases\": {\n");
+		const Phase &v = _phase[ST_VIDEO];
+		const Phase &l = _phase[ST_LUMA];
+		fprintf(f, "    \"audio_scan\":   {\"wall\": %.6f, \"cpu\": %.6f, \"calls\": %lld},\n",
+			_phase[ST_AUDIO].wall, _phase[ST_AUDIO].cpu, (long long)_phase[ST_AUDIO].calls);
+		fprintf(f, "    \"video_decode\": {\"wall\": %.6f, \"cpu\": %.6f, \"calls\": %lld},\n",
+			v.wall - l.wall, v.cpu - l.cpu, (long long)v.calls);
+		fprintf(f, "    \"luma_copy\":    {\"wall\": %.6f, \"cpu\": %.6f, \"calls\": %lld},\n",
+			l.wall, l.cpu, (long long)l.calls);
+		fprintf(f, "    \"mvec\":         {\"wall\": %.6f, \"cpu\": %.6f, \"calls\": %lld},\n",
+			_phase[ST_MVEC].wall, _phase[ST_MVEC].cpu, (long long)_phase[ST_MVEC].calls);
+		fprintf(f, "    \"output\":       {\"wall\": %.6f, \"cpu\": %.6f, \"calls\": %lld}\n",
+			_phase[ST_OUTPUT].wall, _phase[ST_OUTPUT].cpu, (long long)_phase[ST_OUTPUT].calls);
+		fprintf(f, "  },\n");
+		fprintf(f, "  \"frames_decoded\": %lld,\n", (long long)_frames_decoded);
+		fprintf(f, "  \"frames_decoded_unique\": %lld,\n", (long long)unique);
+		fprintf(f, "  \"frames_decoded_again\": %lld,\n", (long long)again);
+		fprintf(f, "  \"audio_reads\": %lld,\n", (long long)_audio_reads);
+		fprintf(f, "  \"audio_samples\": %lld,\n", (long long)_audio_samples);
+		int64_t tree, full, tree_outer;
+		mvec_count_total(&tree, &full, &tree_outer);
+		fprintf(f, "  \"tree_search\": %lld,\n", (long long)tree);
+		fprintf(f, "  \"full_search\": %lld,\n", (long long)full);
+		fprintf(f, "  \"method3_search\": %lld,\n", (long long)tree_outer);
+		fprintf(f, "  \"peak_rss_kb\": %ld,\n", ru.ru_maxrss);
+		fprintf(f, "  \"intervals\": [");
+		for (size_t i=0; i<_intervals.size(); i++) {
+			const Interval &t = _intervals[i];
+			fprintf(f, "%s\n    {\"idx\": %d, \"start\": %d, \"frames\": %d, \"decoded\": %lld, \"wall\": %.6f}",
+				(i > 0) ? "," : "", t.idx, t.start_fr, t.seri, (long long)t.decoded, t.wall);
+		}
+		fprintf(f, "\n  ]\n}\n");
+		fclose(f);
+		return true;
+	}
+
+public:
+	std::string video, audio;		// 入力ファイル名（表示用）
+	int frames;						// 全フレーム数
+	double fps;
+
+	ChapterStats(const char *path) : _path(path), _periodic(0), _pos(0), _frames_decoded(0), _audio_reads(0), _audio_samples(0),
+		_interval_wall(0), frames(0), fps(0) {
+		memset(_phase, 0, sizeof(_phase));
+		_wall_start = stat_clock(CLOCK_MONOTONIC);
+		_cpu_start = stat_clock(CLOCK_PROCESS_CPUTIME_ID);
+		_last_write = _wall_start;
+	}
+
+	void set_frames(int n) {
+		frames = n;
+		_decoded.assign(n > 0 ? n : 0, 0);
+	}
+
+	// 全フレーム数の更新（--followで増えた時）
+	void extend_frames(int n) {
+		std::lock_guard<std::mutex> lk(_lock);
+		if (n > frames) {
+			frames = n;
+			_decoded.resize(n, 0);
+		}
+	}
+
+	void add(int ph, double wall, double cpu) {
+		std::lock_guard<std::mutex> lk(_lock);
+		_phase[ph].wall += wall;
+		_phase[ph].cpu += cpu;
+		_phase[ph].calls++;
+	}
+
+	// 途中経過の出力間隔（--stats-interval）
+	void set_interval(double sec) {
+		_periodic = sec;
+	}
+
+	void add_frame(int frame) {
+		std::lock_guard<std::mutex> lk(_lock);
+		_frames_decoded++;
+		if (frame >= 0 && frame < (int)_decoded.size() && _decoded[frame] < 255) {
+			_decoded[frame]++;
+		}
+		_pos = std::max(_pos, frame);
+		periodic();
+	}
+
+	void add_audio(int frame, int nsamples) {
+		std::lock_guard<std::mutex> lk(_lock);
+		_audio_reads++;
+		_audio_samples += nsamples;
+		_pos = std::max(_pos, frame);
+		periodic();
+	}
+
+	void begin_interval() {
+		_interval_wall = stat_clock(CLOCK_MONOTONIC);
+	}
+
+	// 区間の記録（first〜lastは区間の動き検索で使うフレーム）
+	// --shards/--setでは先に読み込んでおくので、読み込み回数はフレームごとの回数から求める
+	void end_interval(int idx, int start_fr, int seri, int first, int last) {
+		std::lock_guard<std::mutex> lk(_lock);
+		Interval v;
+		v.idx = idx;
+		v.start_fr = start_fr;
+		v.seri = seri;
+		v.decoded = 0;
+		for (int x=std::max(first, 0); x<=last && x<(int)_decoded.size(); x++) {
+			v.decoded += _decoded[x];
+		}
+		v.wall = stat_clock(CLOCK_MONOTONIC) - _interval_wall;
+		_intervals.push_back(v);
+	}
+
+	// JSON出力
+	bool write(bool final, int pos) {
+		std::lock_guard<std::mutex> lk(_lock);
+		return write_locked(final, pos);
+	}
+};
+
+// --stats指定時のみ設定
+extern ChapterStats *g_stats;
+
+// スコープ内の処理時間を集計
+class StatScope {
+	int _ph;
+	double _wall;
+	double _cpu;
+public:
+	StatScope(int ph) : _ph(ph), _wall(0), _cpu(0) {
+		if (g_stats) {
+			_wall = stat_clock(CLOCK_MONOTONIC);
+			_cpu = stat_clock(CLOCK_THREAD_CPUTIME_ID);
+		}
+	}
+	~StatScope() {
+		if (g_stats) {
+			g_stats->add(_ph, stat_clock(CLOCK_MONOTONIC) - _wall, stat_clock(CLOCK_THREAD_CPUTIME_ID) - _cpu);
+		}
+	}
+};
+
+#endif
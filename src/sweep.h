@@ -0,0 +1,119 @@
+// 複数の検索設定をまとめて解析（--set）
+// 音声は１回だけ読み込んでフレームごとの音量最大値を保持し、設定ごとの無音判定はその値から求める。
+// 動き検索は全設定で必要なフレームの和集合を１回だけ行い、結果を全設定で共有する。
+// 動き検索の結果はフレームごとに決まる値なので、設定ごとの出力は個別に実行した時と一致する。
+#ifndef __SWEEP__
+#define __SWEEP__
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "source_reader.h"
+#include "chapter.h"
+#include "trace.h"
+#include "peak.h"
+
+class SweepRunner {
+	struct Set {
+		ChapterParam param;
+		const char *out;
+	};
+	std::vector<Set> _sets;
+
+public:
+	// 追加の検索設定と出力先
+	void add(const ChapterParam &param, const char *out) {
+		Set s;
+		s.param = param;
+		s.out = out;
+		_sets.push_back(s);
+	}
+
+	// "m,s,b,e"形式の設定を解析（空欄はbaseの値）
+	static bool parse(const char *str, const ChapterParam &base, ChapterParam *param) {
+		int *field[4] = { &param->setmute, &param->setseri, &param->breakmute, &param->extendmute };
+		*param = base;
+		const char *p = str;
+		for (int k=0; k<4; k++) {
+			if (*p != ',' && *p != '\0') {
+				char *end;
+				*field[k] = (int)strtol(p, &end, 10);
+				if (end == p) {
+					return false;
+				}
+				p = end;
+			}
+			if (*p == ',') {
+				p++;
+			} else {
+				break;
+			}
+		}
+		return *p == '\0';
+	}
+
+	// baseの結果はwriterに、追加の設定の結果はそれぞれの出力先に出力
+	int run(Source *video, Source *audio, SceneWriter *writer, const ChapterParam &base, const SceneParam &sp,
+		int n, int rate, int scale, int debug)
+	{
+		//--- 音量最大値（音声の読み込みは１回） ---
+		std::vector<int> peak(n > 0 ? n : 0);
+		{
+			TraceScope tr("sweep_audio", "sweep", 0, n);
+			if (n > 0) {
+				read_peaks(audio, 0, n, &peak[0]);
+			}
+		}
+
+		//--- 全設定で動き検索が必要なフレーム ---
+		std::vector<int> frames;
+		for (size_t k=0; k<=_sets.size(); k++) {
+			const ChapterParam &param = (k == 0) ? base : _sets[k-1].param;
+			PeakMuteReader mute(peak, param.setmute);
+			std::vector<int> f;
+			list_scene_frames(&mute, param, n, &f);
+			frames.insert(frames.end(), f.begin(), f.end());
+		}
+		std::sort(frames.begin(), frames.end());
+		frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+
+		//--- 動き検索（昇順に１回ずつ） ---
+		SceneTable scene;
+		scene.scene.resize(n);
+		scene.valid.assign(n, 0);
+		{
+			TraceScope tr("sweep_video", "sweep", 0, (int)frames.size());
+			SourceSceneReader reader(video, sp);
+			for (size_t k=0; k<frames.size(); k++) {
+				reader.get_scene(frames[k], &scene.scene[frames[k]]);
+				scene.valid[frames[k]] = 1;
+			}
+		}
+
+		//--- 設定ごとに判定・出力 ---
+		{
+			PeakMuteReader mute(peak, base.setmute);
+			search_chapter(&mute, &scene, writer, base, n, -1);
+		}
+		int ret = 0;
+		for (size_t k=0; k<_sets.size(); k++) {
+			const ChapterParam &param = _sets[k].param;
+			printf("set %d: mute: %d seri: %d bmute: %d emute: %d -> %s\n", (int)k + 2,
+				param.setmute, param.setseri, param.breakmute, param.extendmute, _sets[k].out);
+			FILE *fout = fopen(_sets[k].out, "w");
+			if (fout == NULL) {
+				printf("Error: output file open failed. (%s)\n", _sets[k].out);
+				ret = -1;
+				continue;
+			}
+			PeakMuteReader mute(peak, param.setmute);
+			ChapterFileWriter w(fout, rate, scale, debug);
+			search_chapter(&mute, &scene, &w, param, n, -1);
+			w.write_end(n);
+			fclose(fout);
+		}
+		return ret;
+	}
+};
+
+#endif
@@ -0,0 +1,379 @@
+// 合成ソース（動作確認用）
+// 入力ファイル名に "synth://シナリオ名" または "synth://シナリオ名@幅x高さ" を指定すると
+// 画像・音声を内部で生成する。AviSynthや動画ファイルなしで全体の処理を確認するために使用。
+// 末尾に "?grow=フレーム数" を付けると録画中のファイルを模して、refresh()ごとに読み込み可能な
+// フレーム数を指定数ずつ増やす（--followの確認用）。
+// "?pillar=幅" を付けると左右に指定幅の黒帯を付ける（--roiの確認用）。"&"で複数指定できる。
+// "?field=値" を付けるとフレームプロパティ_FieldBasedがあるソースを模す（--picture autoの確認用）。
+// "?audio=s24|s32|float" を付けると音声をその形式で出力する（16bitに変換すると元の値に戻る下位ビット・端数付き）。
+#ifndef __SYNTHETIC__
+#define __SYNTHETIC__
+
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "source.h"
+
+// 区間の画像内容
+enum {
+	SV_SCENE = 0,		// 動きのある模様（sceneごとに別模様）
+	SV_BLANK,			// 黒画面
+	SV_FADEOUT,			// 黒へフェードアウト
+	SV_FADEIN,			// 黒からフェードイン
+	SV_ICUT,			// 先頭フレームだけ片フィールドが前シーンのまま（インターレースでのシーンチェンジ）
+	SV_STILL			// 静止画
+};
+// 区間の音声内容
+enum {
+	SA_TONE = 0,		// 1kHz正弦波
+	SA_SILENT,			// 無音
+	SA_LOWNOISE			// 閾値以下の小さなノイズ
+};
+
+struct SynthSegment {
+	int frames;			// 区間フレーム数
+	int scene;			// 模様番号
+	int video;			// 画像内容（SV_*）
+	int audio;			// 音声内容（SA_*）
+};
+
+struct SynthScenario {
+	const char *name;
+	const SynthSegment *seg;
+	int nseg;
+};
+
+// 無音中にシーンチェンジ
+static const SynthSegment synth_basic[] = {
+	{ 300, 1, SV_SCENE,  SA_TONE     },
+	{  10, 1, SV_SCENE,  SA_SILENT   },
+	{  10, 2, SV_SCENE,  SA_SILENT   },
+	{ 300, 2, SV_SCENE,  SA_TONE     },
+	{   8, 2, SV_SCENE,  SA_LOWNOISE },
+	{   8, 3, SV_SCENE,  SA_LOWNOISE },
+	{ 200, 3, SV_SCENE,  SA_TONE     },
+	{   5, 3, SV_SCENE,  SA_SILENT   },		// 最低無音フレーム数未満
+	{ 200, 3, SV_SCENE,  SA_TONE     },
+};
+// 15/30/60秒のCM構成
+static const SynthSegment synth_cm[] = {
+	{ 592, 1, SV_SCENE,  SA_TONE     },
+	{   8, 1, SV_SCENE,  SA_SILENT   },
+	{   8, 2, SV_SCENE,  SA_SILENT   },		// 15秒
+	{ 434, 2, SV_SCENE,  SA_TONE     },
+	{   8, 2, SV_SCENE,  SA_SILENT   },
+	{   8, 3, SV_SCENE,  SA_SILENT   },		// 30秒
+	{ 884, 3, SV_SCENE,  SA_TONE     },
+	{   8, 3, SV_SCENE,  SA_SILENT   },
+	{   8, 4, SV_SCENE,  SA_SILENT   },		// 60秒
+	{1784, 4, SV_SCENE,  SA_TONE     },
+	{   8, 4, SV_SCENE,  SA_SILENT   },
+	{   8, 5, SV_SCENE,  SA_SILENT   },		// 15秒
+	{ 434, 5, SV_SCENE,  SA_TONE     },
+	{   8, 5, SV_SCENE,  SA_SILENT   },
+	{   8, 6, SV_SCENE,  SA_SILENT   },
+	{ 300, 6, SV_SCENE,  SA_TONE     },
+};
+// フェードアウト・フェードイン
+static const SynthSegment synth_fade[] = {
+	{ 300, 1, SV_SCENE,   SA_TONE    },
+	{  12, 1, SV_FADEOUT, SA_SILENT  },
+	{   6, 0, SV_BLANK,   SA_SILENT  },
+	{  12, 2, SV_FADEIN,  SA_SILENT  },
+	{ 300, 2, SV_SCENE,   SA_TONE    },
+};
+// 無音中の黒画面
+static const SynthSegment synth_blank[] = {
+	{ 300, 1, SV_SCENE,  SA_TONE     },
+	{  30, 0, SV_BLANK,  SA_SILENT   },
+	{ 300, 2, SV_SCENE,  SA_TONE     },
+	{  12, 0, SV_BLANK,  SA_SILENT   },
+	{   6, 3, SV_SCENE,  SA_SILENT   },
+	{ 300, 3, SV_SCENE,  SA_TONE     },
+};
+// インターレースでのシーンチェンジ
+static const SynthSegment synth_interlace[] = {
+	{ 300, 1, SV_SCENE,  SA_TONE     },
+	{   9, 1, SV_SCENE,  SA_SILENT   },
+	{   9, 2, SV_ICUT,   SA_SILENT   },
+	{ 300, 2, SV_SCENE,  SA_TONE     },
+	{   7, 2, SV_SCENE,  SA_SILENT   },
+	{   7, 3, SV_ICUT,   SA_SILENT   },
+	{ 300, 3, SV_SCENE,  SA_TONE     },
+};
+// 長時間無音（エンドカード）内の複数シーンチェンジ
+static const SynthSegment synth_long[] = {
+	{ 300, 1, SV_SCENE,  SA_TONE     },
+	{  20, 1, SV_SCENE,  SA_SILENT   },
+	{  90, 2, SV_STILL,  SA_SILENT   },
+	{  90, 3, SV_STILL,  SA_SILENT   },
+	{  20, 4, SV_SCENE,  SA_SILENT   },
+	{ 300, 4, SV_SCENE,  SA_TONE     },
+};
+// 静止画のみ（動きがないのでインターレースか判定できない）
+static const SynthSegment synth_still[] = {
+	{ 300, 1, SV_STILL,  SA_TONE     },
+	{  10, 1, SV_STILL,  SA_SILENT   },
+	{  10, 2, SV_STILL,  SA_SILENT   },
+	{ 300, 2, SV_STILL,  SA_TONE     },
+};
+
+#define SYNTH_SCENARIO(a) { #a, synth_##a, (int)(sizeof(synth_##a) / sizeof(synth_##a[0])) }
+static const SynthScenario synth_scenarios[] = {
+	SYNTH_SCENARIO(basic),
+	SYNTH_SCENARIO(cm),
+	SYNTH_SCENARIO(fade),
+	SYNTH_SCENARIO(blank),
+	SYNTH_SCENARIO(interlace),
+	SYNTH_SCENARIO(long),
+	SYNTH_SCENARIO(still),
+};
+#undef SYNTH_SCENARIO
+
+class SyntheticSource : public NullSource {
+	const SynthScenario *_sc;
+	int _total;									// 全フレーム数
+	int _grow;									// refresh()ごとに増やすフレーム数（0なら最初から全て）
+	int _pillar;								// 左右の黒帯の幅
+	int _field;									// field_based()の値（-1はプロパティなし）
+	int _bits;									// 音声のビット数（32bitのfloatはWAVE_FORMAT_IEEE_FLOAT）
+	bool _float;
+	std::vector<int> _seg_start;				// 各区間の開始フレーム
+	std::vector<std::vector<unsigned char> > _tex;	// 模様（scene番号ごと）
+	BITMAPINFOHEADER _format;
+	WAVEFORMATEX _audio_format;
+
+	static const int TEX_SIZE = 256;
+
+	// 模様作成
+	const unsigned char *texture(int scene) {
+		if ((int)_tex.size() <= scene) {
+			_tex.resize(scene + 1);
+		}
+		std::vector<unsigned char> &t = _tex[scene];
+		if (t.empty()) {
+			t.resize(TEX_SIZE * TEX_SIZE);
+			uint32_t r = 12345 + scene * 7919;
+			for (int y=0; y<TEX_SIZE; y++) {
+				for (int x=0; x<TEX_SIZE; x++) {
+					r = r * 1103515245 + 12345;
+					double v = 50 + (scene * 53) % 140
+								   + 40 * sin(x * (2 * M_PI / TEX_SIZE) * (2 + scene % 3) + scene)
+									   * cos(y * (2 * M_PI / TEX_SIZE) * (3 + scene % 2) - scene)
+								   + 20 * sin((x + y * (scene + 1)) * (2 * M_PI / TEX_SIZE) * 5)
+								   + (int)((r >> 16) % 31) - 15;
+					t[y * TEX_SIZE + x] = (unsigned char)std::min(235.0, std::max(16.0, v));
+				}
+			}
+		}
+		return &t[0];
+	}
+
+	int find_segment(int frame) {
+		int k = (int)(std::upper_bound(_seg_start.begin(), _seg_start.end(), frame) - _seg_start.begin()) - 1;
+		return std::max(0, std::min(k, _sc->nseg - 1));
+	}
+
+	// 16bitの値vを音声の形式で書き込む（rは下位ビット・端数に使う乱数）
+	unsigned char *write_sample(unsigned char *out, short v, int r) {
+		if (_float) {
+			// 32768倍して丸めるとvに戻る端数（±0.49）
+			float f = (v + ((r & 0xFFFF) % 99 - 49) / 100.0f) / 32768.0f;
+			memcpy(out, &f, 4);
+			return out + 4;
+		}
+		if (_bits == 32) {
+			int32_t s = (int32_t)((uint32_t)(uint16_t)v << 16 | (r & 0xFFFF));
+			memcpy(out, &s, 4);
+			return out + 4;
+		}
+		if (_bits == 24) {
+			out[0] = (unsigned char)r;
+			out[1] = (unsigned char)v;
+			out[2] = (unsigned char)(v >> 8);
+			return out + 3;
+		}
+		memcpy(out, &v, 2);
+		return out + 2;
+	}
+
+	// 1ライン分の画像生成
+	void render_line(unsigned char *dst, int w, int y, int scene, int frame, int video, int level, int den) {
+		if (video == SV_BLANK || scene <= 0) {
+			memset(dst, 16, w);
+			return;
+		}
+		const unsigned char *t = texture(scene);
+		int dx = (video == SV_STILL) ? 0 : frame * (1 + scene % 3);
+		int dy = (video == SV_STILL) ? 0 : frame * (scene % 2);
+		const unsigned char *line = t + ((y + dy) & (TEX_SIZE - 1)) * TEX_SIZE;
+		for (int x=0; x<w; x++) {
+			int v = line[(x + dx) & (TEX_SIZE - 1)];
+			dst[x] = (unsigned char)(16 + (v - 16) * level / den);
+		}
+	}
+
+public:
+	SyntheticSource() : NullSource(), _sc(NULL), _total(0), _grow(0), _pillar(0), _field(-1), _bits(16), _float(false) {
+		memset(&_format, 0, sizeof(_format));
+		memset(&_audio_format, 0, sizeof(_audio_format));
+	}
+
+	// synth://で始まるファイル名か確認
+	static bool is_synthetic(const char *infile) {
+		return strncmp(infile, "synth://", 8) == 0;
+	}
+
+	void init(const char *infile) {
+		printf(" -SyntheticSource\n");
+		string name = infile + 8;
+		int w = 720;
+		int h = 480;
+		size_t q = name.find('?');
+		if (q != name.npos) {
+			string opt = name.substr(q + 1);
+			name = name.substr(0, q);
+			while (opt.empty() == false) {
+				size_t a = opt.find('&');
+				string o = opt.substr(0, a);
+				opt = (a == opt.npos) ? "" : opt.substr(a + 1);
+				if (sscanf(o.c_str(), "grow=%d", &_grow) == 1 && _grow > 0) {
+					continue;
+				}
+				if (sscanf(o.c_str(), "pillar=%d", &_pillar) == 1 && _pillar > 0) {
+					continue;
+				}
+				if (sscanf(o.c_str(), "field=%d", &_field) == 1 && _field >= 0) {
+					continue;
+				}
+				if (o == "audio=s24" || o == "audio=s32" || o == "audio=float") {
+					_bits = (o == "audio=s24") ? 24 : 32;
+					_float = (o == "audio=float");
+					continue;
+				}
+				throw "   illegal synthetic option.";
+			}
+		}
+		size_t p = name.find('@');
+		if (p != name.npos) {
+			if (sscanf(name.c_str() + p + 1, "%dx%d", &w, &h) != 2 || w < 64 || h < 64) {
+				throw "   illegal synthetic size.";
+			}
+			name = name.substr(0, p);
+		}
+		for (size_t i=0; i<sizeof(synth_scenarios) / sizeof(synth_scenarios[0]); i++) {
+			if (name == synth_scenarios[i].name) {
+				_sc = &synth_scenarios[i];
+			}
+		}
+		if (_sc == NULL) {
+			throw "   unknown synthetic scenario.";
+		}
+
+		int n = 0;
+		for (int i=0; i<_sc->nseg; i++) {
+			_seg_start.push_back(n);
+			n += _sc->seg[i].frames;
+		}
+
+		_format.biSize = sizeof(_format);
+		_format.biWidth = w;
+		_format.biHeight = h;
+		_audio_format.wFormatTag = _float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+		_audio_format.nChannels = 2;
+		_audio_format.nSamplesPerSec = 48000;
+		_audio_format.wBitsPerSample = _bits;
+		_audio_format.nBlockAlign = _audio_format.wBitsPerSample / 8 * _audio_format.nChannels;
+		_audio_format.nAvgBytesPerSec = _audio_format.nBlockAlign * _audio_format.nSamplesPerSec;
+
+		_ip.flag = INPUT_INFO_FLAG_VIDEO | INPUT_INFO_FLAG_AUDIO | INPUT_INFO_FLAG_VIDEO_RANDOM_ACCESS;
+		_ip.rate = 30000;
+		_ip.scale = 1001;
+		_total = n;
+		_ip.n = (_grow > 0) ? std::min(_grow, n) : n;
+		_ip.format = &_format;
+		_ip.format_size = sizeof(_format);
+		_ip.audio_format = &_audio_format;
+		_ip.audio_format_size = sizeof(_audio_format);
+		_ip.audio_n = (int)((double)_ip.n * _audio_format.nSamplesPerSec / _ip.rate * _ip.scale);
+	}
+
+	// 録画中を模して読み込み可能なフレーム数を増やす
+	int refresh() {
+		if (_grow > 0 && _ip.n < _total) {
+			_ip.n = std::min(_ip.n + _grow, _total);
+			_ip.audio_n = (int)((double)_ip.n * _audio_format.nSamplesPerSec / _ip.rate * _ip.scale);
+		}
+		return _ip.n;
+	}
+
+	bool read_video_y8(int frame, unsigned char *luma) {
+		if (frame < 0 || frame >= _ip.n) {
+			return false;
+		}
+		int w = _ip.format->biWidth & 0xFFFFFFF0;
+		int h = _ip.format->biHeight & 0xFFFFFFF0;
+		int k = find_segment(frame);
+		const SynthSegment &s = _sc->seg[k];
+		int pos = frame - _seg_start[k];		// 区間内の位置
+		int prev_scene = (k > 0) ? _sc->seg[k-1].scene : 0;
+
+		for (int y=0; y<h; y++) {
+			unsigned char *dst = luma + y * w;
+			switch (s.video) {
+			case SV_FADEOUT:
+				render_line(dst, w, y, s.scene, frame, s.video, s.frames - pos, s.frames + 1);
+				break;
+			case SV_FADEIN:
+				render_line(dst, w, y, s.scene, frame, s.video, pos + 1, s.frames + 1);
+				break;
+			case SV_ICUT:
+				if (pos == 0 && (y & 1)) {		// ボトムフィールドは前シーンのまま
+					render_line(dst, w, y, prev_scene, frame, SV_SCENE, 1, 1);
+				} else {
+					render_line(dst, w, y, s.scene, frame, SV_SCENE, 1, 1);
+				}
+				break;
+			default:
+				render_line(dst, w, y, s.scene, frame, s.video, 1, 1);
+				break;
+			}
+			if (_pillar > 0) {
+				int pw = std::min(_pillar, w / 2);
+				memset(dst, 16, pw);
+				memset(dst + w - pw, 16, pw);
+			}
+		}
+		return true;
+	}
+
+	int field_based(int frame) {
+		return _field;
+	}
+
+	int read_audio(int frame, short *buf) {
+		int64_t start = (int64_t)((double)frame * _ip.audio_format->nSamplesPerSec / _ip.rate * _ip.scale);
+		int64_t end = (int64_t)((double)(frame + 1) * _ip.audio_format->nSamplesPerSec / _ip.rate * _ip.scale);
+		if (frame < 0 || frame >= _ip.n) {
+			return 0;
+		}
+		int audio = _sc->seg[find_segment(frame)].audio;
+		unsigned char *out = (unsigned char*)buf;
+		for (int64_t i=start; i<end; i++) {
+			short v;
+			if (audio == SA_TONE) {
+				v = (short)(8000 * sin(2 * M_PI * 1000 * i / _audio_format.nSamplesPerSec));
+			} else if (audio == SA_LOWNOISE) {
+				v = (short)((i * 7919) % 41) - 20;
+			} else {
+				v = 0;
+			}
+			for (int ch=0; ch<2; ch++) {
+				out = write_sample(out, v, (int)((i * 2 + ch) * 2654435761u >> 8));
+			}
+		}
+		return (int)(end - start);
+	}
+};
+
+#endif
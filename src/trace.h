@@ -0,0 +1,139 @@
+// 処理区間のタイムライン出力（--trace）
+// Chrome/Perfettoのtrace event形式(JSON)で出力する。
+// 記録中はスレッドごとのバッファに溜めるだけにして（ロックなし）、ファイル出力は終了時にまとめて行う。
+#ifndef __TRACE__
+#define __TRACE__
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include "stats.h"
+
+class ChapterTrace {
+	struct Event {
+		const char *name;	// 区間名（文字列リテラルのみ）
+		const char *cat;	// 分類
+		double ts;			// 開始時刻（秒）
+		double dur;			// 処理時間（秒）
+		int tid;			// スレッドID
+		int frame;			// フレーム番号（無い時は-1）
+		int arg;			// 付加情報（無い時は-1）
+	};
+	// スレッドごとの記録
+	struct Buffer {
+		int tid;			// スレッドID
+		std::vector<Event> events;
+	};
+
+	std::string _path;
+	double _start;
+	int _id;						// 記録ごとの番号（スレッドのバッファの持ち主）
+	std::vector<Buffer*> _buffers;
+	std::mutex _lock;				// _buffersへの追加・出力時のみ
+
+	static int next_id() {
+		static std::atomic<int> id(0);
+		return ++id;
+	}
+
+	// このスレッドのバッファ（スレッドごとに最初の１回だけロックして登録）
+	Buffer *buffer() {
+		static thread_local int owner = 0;
+		static thread_local Buffer *buf = NULL;
+		if (owner != _id) {
+			buf = new Buffer;
+			buf->tid = (int)syscall(SYS_gettid);
+			buf->events.reserve(4096);
+			std::lock_guard<std::mutex> lk(_lock);
+			_buffers.push_back(buf);
+			owner = _id;
+		}
+		return buf;
+	}
+
+public:
+	ChapterTrace(const char *path) : _path(path), _id(next_id()) {
+		_start = stat_clock(CLOCK_MONOTONIC);
+	}
+	~ChapterTrace() {
+		for (size_t k=0; k<_buffers.size(); k++) {
+			delete _buffers[k];
+		}
+	}
+
+	double now() {
+		return stat_clock(CLOCK_MONOTONIC);
+	}
+
+	void add(const char *name, const char *cat, double begin, double end, int frame, int arg) {
+		Buffer *buf = buffer();
+		Event e;
+		e.name = name;
+		e.cat = cat;
+		e.ts = begin - _start;
+		e.dur = end - begin;
+		e.tid = buf->tid;
+		e.frame = frame;
+		e.arg = arg;
+		buf->events.push_back(e);
+	}
+
+	bool write() {
+		FILE *f = fopen(_path.c_str(), "w");
+		if (f == NULL) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lk(_lock);
+		fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"chapter_exe\"}}", (int)getpid());
+		// 並列処理のスレッドは終了済み（スレッドごとのバッファを順に出力）
+		for (size_t k=0; k<_buffers.size(); k++) {
+			const std::vector<Event> &events = _buffers[k]->events;
+			for (size_t i=0; i<events.size(); i++) {
+				const Event &e = events[i];
+				fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {",
+					e.name, e.cat, e.ts * 1e6, e.dur * 1e6, (int)getpid(), e.tid);
+				if (e.frame >= 0) {
+					fprintf(f, "\"frame\": %d", e.frame);
+				}
+				if (e.arg >= 0) {
+					fprintf(f, "%s\"arg\": %d", (e.frame >= 0) ? ", " : "", e.arg);
+				}
+				fprintf(f, "}}");
+			}
+		}
+		fprintf(f, "\n]}\n");
+		fclose(f);
+		return true;
+	}
+};
+
+// --trace指定時のみ設定
+extern ChapterTrace *g_trace;
+
+// スコープ内の処理区間を記録
+class TraceScope {
+	const char *_name;
+	const char *_cat;
+	int _frame;
+	int _arg;
+	double _begin;
+public:
+	TraceScope(const char *name, const char *cat, int frame, int arg = -1)
+		: _name(name), _cat(cat), _frame(frame), _arg(arg), _begin(0) {
+		if (g_trace) {
+			_begin = g_trace->now();
+		}
+	}
+	~TraceScope() {
+		if (g_trace) {
+			g_trace->add(_name, _cat, _begin, g_trace->now(), _frame, _arg);
+		}
+	}
+};
+
+#endif